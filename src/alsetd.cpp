@@ -0,0 +1,715 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdarg>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "drivers.hpp"
+#include "inputlog.hpp"
+#include "credentials.hpp"
+
+using namespace std;
+
+/* Serves one running fleet to any number of operators over a Unix socket, a line-based session per connection:
+     login <user> <password>     fleet     attach <vehicle>     detach
+     env <code> <value>          vehicle <code> <value>         quit
+   Replies start with "ok" or "error". An attached session gets a status line for its vehicle after every
+   tick; one that stops reading loses status lines instead of holding up the fleet. Commands use the codes
+   of the environment and vehicle menus and are applied inside the next tick. Passwords are checked on a
+   few threads of their own, a stretched hash takes long enough to hold up every session if it ran in the loop,
+   and the checks waiting for them are capped per peer user and overall. */
+
+const size_t MAX_LINE = 256;
+const size_t MAX_QUEUED_OUTPUT = 64 * 1024;    // status lines are dropped past this
+const size_t MAX_REPLY_OUTPUT = 256 * 1024;    // a session that never reads its replies is closed
+const size_t MAX_QUEUED_INPUT = 16 * 1024;     // lines that arrive while a login is being checked
+const int MAX_LOGIN_FAILURES = 3;              // per connection
+const int MAX_USER_FAILURES = 5;               // in a row for one account before it is locked
+const int MAX_LOCKOUT_SECONDS = 900;           // the lock doubles from 1 s with every further failure
+const int MAX_PENDING_LOGINS = 64;             // password checks queued or running for all sessions
+const int MAX_PEER_LOGINS = 4;                 // of those, for connections from one user id
+const unsigned MAX_VERIFIERS = 4;              // threads checking passwords
+const int MAX_COMMANDS_PER_TICK = 16;
+
+const char *gear_names[] = {"P", "R", "N", "D"};
+
+struct session {
+    int fd;                 // -1 when the slot is free
+    uint64_t serial;        // tells a login result for an earlier session on the same fd apart
+    bool authenticated;
+    bool verifying;         // a login is being checked, later lines wait
+    bool hung_up;           // the peer sent everything it will
+    uid_t peer;             // user id at the other end of the socket
+    int login_failures;
+    long vehicle;           // -1 when not attached
+    int commands_this_tick;
+    uint32_t events;        // what the session is registered for
+    bool closing;           // closed once the output is flushed
+    uint64_t dropped;
+    string user;
+    string input;
+    string output;
+    size_t output_sent;
+};
+
+struct queued_command {
+    long vehicle;
+    InputCommand command;
+};
+
+struct login_request {
+    int fd;
+    uint64_t serial;
+    uid_t peer;
+    string user;
+    string password;
+    bool accepted;
+    string full_name;
+};
+
+struct user_failures {
+    int count;
+    chrono::steady_clock::time_point locked_until;
+};
+
+/* checks passwords in the background, results are picked up when its eventfd turns readable */
+class login_verifier {
+
+    private:
+
+    const CredentialStore *store;
+    credential_record nobody;       // unknown users are checked against this, so timing doesn't tell which names exist
+    mutex lock;
+    condition_variable wake;
+    deque<login_request> pending;
+    deque<login_request> done;
+    bool stopping;
+    int notify_fd;
+    vector<thread> workers;
+
+    void run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&]() { return stopping || !pending.empty(); });
+            if (stopping) return;
+            login_request request = move(pending.front());
+            pending.pop_front();
+            guard.unlock();
+
+            const credential_record *record = store->find(request.user.c_str());
+            bool matches = CredentialStore::verify(record != NULL ? record : &nobody, request.password.c_str());
+            request.accepted = record != NULL && matches;
+            if (request.accepted) request.full_name.assign(record->full_name, strnlen(record->full_name, sizeof(record->full_name)));
+            request.password.assign(request.password.size(), '\0');
+
+            guard.lock();
+            done.push_back(move(request));
+            uint64_t one = 1;
+            ssize_t written = write(notify_fd, &one, sizeof(one));
+            (void)written;
+        }
+    }
+
+    public:
+
+    login_verifier() {
+        store = NULL;
+        memset(&nobody, 0, sizeof(nobody));
+        stopping = false;
+        notify_fd = -1;
+    }
+
+    ~login_verifier() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread &t : workers) t.join();
+        if (notify_fd >= 0) close(notify_fd);
+    }
+
+    bool start(const CredentialStore &credentials) {
+        store = &credentials;
+        nobody.iterations = credentials.iterations();
+        notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (notify_fd < 0) return false;
+        unsigned count = min(MAX_VERIFIERS, max(1u, thread::hardware_concurrency()));
+        for (unsigned i = 0; i < count; i++) workers.push_back(thread(&login_verifier::run, this));
+        return true;
+    }
+
+    int get_notify_fd() const { return notify_fd; }
+
+    void submit(login_request &&request) {
+        {
+            lock_guard<mutex> guard(lock);
+            pending.push_back(move(request));
+        }
+        wake.notify_one();
+    }
+
+    /* the next finished check, false when there are none left */
+    bool take(login_request &result) {
+        lock_guard<mutex> guard(lock);
+        if (done.empty()) return false;
+        result = move(done.front());
+        done.pop_front();
+        return true;
+    }
+
+};
+
+struct server {
+    int epoll_fd;
+    int listen_fd;
+    int timer_fd;
+    int signal_fd;
+    size_t max_sessions;
+    size_t session_count;
+    uint64_t sessions_served;
+    vector<session> sessions;       // indexed by file descriptor
+    vector<Planning> vehicles;
+    vector<queued_command> queue;
+    DriverScheduler drivers;
+    CredentialStore store;
+    login_verifier verifier;
+    map<string, user_failures> failures;    // only accounts in the store, so it cannot grow past it
+    map<uid_t, int> peer_logins;            // password checks in flight by peer user id, no zero counts
+    int pending_logins;
+    uint64_t next_serial;
+    uint64_t tick;
+};
+
+bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool watch(server &srv, int fd, uint32_t events, int op = EPOLL_CTL_ADD) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(srv.epoll_fd, op, fd, &event) == 0;
+}
+
+void close_session(server &srv, session &s) {
+    if (s.authenticated) cout << s.user << " logged out, " << s.dropped << " status lines dropped" << endl;
+    epoll_ctl(srv.epoll_fd, EPOLL_CTL_DEL, s.fd, NULL);
+    close(s.fd);
+    s.fd = -1;
+    s.user.clear();
+    s.input.clear();
+    s.output.clear();
+    srv.session_count--;
+}
+
+/* input until the session is closing or the peer hung up, a hung-up peer would keep EPOLLIN ready forever;
+   output while some is queued */
+void update_events(server &srv, session &s) {
+    uint32_t wanted = 0;
+    if (!s.closing && !s.hung_up) wanted |= EPOLLIN;
+    if (s.output_sent < s.output.size()) wanted |= EPOLLOUT;
+    if (s.events != wanted && watch(srv, s.fd, wanted, EPOLL_CTL_MOD)) s.events = wanted;
+}
+
+/* sends what the socket takes without blocking, waits for EPOLLOUT for the rest */
+void flush_session(server &srv, session &s) {
+    while (s.output_sent < s.output.size()) {
+        ssize_t sent = send(s.fd, s.output.data() + s.output_sent, s.output.size() - s.output_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            s.output_sent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && s.output.size() - s.output_sent <= MAX_REPLY_OUTPUT) {
+            update_events(srv, s);
+            return;
+        }
+        close_session(srv, s);
+        return;
+    }
+    s.output.clear();
+    s.output_sent = 0;
+    if (s.closing) {
+        close_session(srv, s);
+        return;
+    }
+    update_events(srv, s);
+}
+
+void reply(session &s, const char *format, ...) {
+    char line[MAX_LINE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0) return;
+    if ((size_t)length > sizeof(line) - 2) length = sizeof(line) - 2;
+    line[length++] = '\n';
+    s.output.append(line, length);
+}
+
+bool parse_int(const char *text, long low, long high, long &value) {
+    if (text == NULL) return false;
+    char *end;
+    errno = 0;
+    value = strtol(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= low && value <= high;
+}
+
+void login_failed(session &s) {
+    s.login_failures++;
+    if (s.login_failures >= MAX_LOGIN_FAILURES) s.closing = true;
+}
+
+void handle_line(server &srv, session &s, char *line) {
+    char *rest = NULL;
+    char *word = strtok_r(line, " \t", &rest);
+    if (word == NULL) return;
+
+    if (strcmp(word, "quit") == 0) {
+        reply(s, "ok bye");
+        s.closing = true;
+        return;
+    }
+    if (strcmp(word, "login") == 0) {
+        char *user = strtok_r(NULL, " \t", &rest);
+        while (rest != NULL && (*rest == ' ' || *rest == '\t')) rest++;
+        const char *password = rest != NULL ? rest : "";
+        if (s.authenticated) {
+            reply(s, "error already logged in as %s", s.user.c_str());
+            return;
+        }
+        if (user == NULL) {
+            reply(s, "error expected login <user> <password>");
+            return;
+        }
+        map<string, user_failures>::iterator failed = srv.failures.find(user);
+        if (failed != srv.failures.end() && failed->second.locked_until > chrono::steady_clock::now()) {
+            login_failed(s);
+            reply(s, "error too many failed logins for %s, try again later", user);
+            return;
+        }
+        // one check per session at a time, but a peer can open many sessions
+        map<uid_t, int>::iterator peer = srv.peer_logins.find(s.peer);
+        if (srv.pending_logins >= MAX_PENDING_LOGINS || (peer != srv.peer_logins.end() && peer->second >= MAX_PEER_LOGINS)) {
+            reply(s, "error too many logins in progress, try again later");
+            return;
+        }
+        srv.pending_logins++;
+        srv.peer_logins[s.peer]++;
+        login_request request;
+        request.fd = s.fd;
+        request.serial = s.serial;
+        request.peer = s.peer;
+        request.user = user;
+        request.password = password;
+        request.accepted = false;
+        srv.verifier.submit(move(request));
+        s.verifying = true;
+        return;
+    }
+    if (!s.authenticated) {
+        reply(s, "error login first");
+        return;
+    }
+
+    if (strcmp(word, "fleet") == 0) {
+        reply(s, "ok %zu vehicles tick %llu", srv.vehicles.size(), (unsigned long long)srv.tick);
+    } else if (strcmp(word, "attach") == 0) {
+        long vehicle;
+        if (!parse_int(strtok_r(NULL, " \t", &rest), 0, (long)srv.vehicles.size() - 1, vehicle)) {
+            reply(s, "error expected a vehicle from 0 to %zu", srv.vehicles.size() - 1);
+            return;
+        }
+        s.vehicle = vehicle;
+        reply(s, "ok attached %ld", vehicle);
+    } else if (strcmp(word, "detach") == 0) {
+        s.vehicle = -1;
+        reply(s, "ok detached");
+    } else if (strcmp(word, "env") == 0 || strcmp(word, "vehicle") == 0) {
+        bool environment = word[0] == 'e';
+        long code, value;
+        if (s.vehicle < 0) {
+            reply(s, "error attach to a vehicle first");
+        } else if (!parse_int(strtok_r(NULL, " \t", &rest), 0, environment ? 5 : 4, code)
+                   || !parse_int(strtok_r(NULL, " \t", &rest), INT32_MIN, INT32_MAX, value)) {
+            reply(s, "error expected %s <code 0-%d> <value>", word, environment ? 5 : 4);
+        } else if (s.commands_this_tick >= MAX_COMMANDS_PER_TICK) {
+            reply(s, "error too many commands this tick");
+        } else {
+            queued_command queued;
+            queued.vehicle = s.vehicle;
+            queued.command.tick = srv.tick;
+            queued.command.value = (int32_t)value;
+            queued.command.menu = environment ? INPUT_ENVIRONMENT : INPUT_VEHICLE;
+            queued.command.code = (uint8_t)code;
+            queued.command.unused = 0;
+            srv.queue.push_back(queued);
+            s.commands_this_tick++;
+            reply(s, "ok queued for tick %llu", (unsigned long long)srv.tick);
+        }
+    } else {
+        reply(s, "error unknown command %s", word);
+    }
+}
+
+void process_lines(server &srv, session &s);
+
+void read_session(server &srv, session &s) {
+    char buffer[4096];
+    bool hung_up = false;
+    while (true) {
+        ssize_t received = recv(s.fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (received < 0) {
+            close_session(srv, s);
+            return;
+        }
+        if (received == 0) {
+            hung_up = true;     // still answers what arrived before the hangup
+            break;
+        }
+        s.input.append(buffer, received);
+        if (s.closing) s.input.clear();
+    }
+    if (hung_up) s.hung_up = true;
+    if (s.verifying && s.input.size() > MAX_QUEUED_INPUT) {
+        reply(s, "error too much input while logging in");
+        s.closing = true;
+    }
+    process_lines(srv, s);
+}
+
+/* handles the complete lines that have arrived, up to a login that still has to be checked */
+void process_lines(server &srv, session &s) {
+    size_t start = 0;
+    while (!s.closing && !s.verifying) {
+        size_t end = s.input.find('\n', start);
+        if (end == string::npos) break;
+        if (end > start && s.input[end - 1] == '\r') s.input[end - 1] = '\0';
+        s.input[end] = '\0';
+        if (end - start < MAX_LINE) handle_line(srv, s, &s.input[start]);
+        else reply(s, "error line too long");
+        start = end + 1;
+    }
+    s.input.erase(0, start);
+    if (!s.verifying && s.input.size() >= MAX_LINE) {
+        reply(s, "error line too long");
+        s.closing = true;
+    }
+    if (s.hung_up && !s.verifying) s.closing = true;
+    if (s.closing) s.input.clear();
+    flush_session(srv, s);
+}
+
+void finish_login(server &srv, login_request &result) {
+    srv.pending_logins--;
+    map<uid_t, int>::iterator peer = srv.peer_logins.find(result.peer);
+    if (--peer->second == 0) srv.peer_logins.erase(peer);
+
+    map<string, user_failures>::iterator failed = srv.failures.find(result.user);
+    if (result.accepted) {
+        if (failed != srv.failures.end()) srv.failures.erase(failed);
+    } else if (srv.store.find(result.user.c_str()) != NULL) {
+        if (failed == srv.failures.end()) failed = srv.failures.insert(make_pair(result.user, user_failures{0, {}})).first;
+        user_failures &f = failed->second;
+        f.count++;
+        if (f.count >= MAX_USER_FAILURES) {
+            int seconds = min(MAX_LOCKOUT_SECONDS, 1 << min(f.count - MAX_USER_FAILURES, 10));
+            f.locked_until = chrono::steady_clock::now() + chrono::seconds(seconds);
+            cout << result.user << " locked for " << seconds << " s after " << f.count << " failed logins" << endl;
+        }
+    }
+
+    if (result.fd < 0 || (size_t)result.fd >= srv.sessions.size()) return;
+    session &s = srv.sessions[result.fd];
+    if (s.fd != result.fd || s.serial != result.serial) return;     // gone while it was being checked
+    s.verifying = false;
+    if (result.accepted) {
+        s.authenticated = true;
+        s.user = result.user;
+        cout << s.user << " logged in" << endl;
+        reply(s, "ok welcome %s", result.full_name.c_str());
+    } else {
+        login_failed(s);
+        reply(s, "error invalid login");
+    }
+    process_lines(srv, s);
+}
+
+void accept_sessions(server &srv) {
+    while (true) {
+        int fd = accept4(srv.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;     // EAGAIN, or out of descriptors until a session closes
+        }
+        if (srv.session_count >= srv.max_sessions) {
+            const char *full = "error server full\n";
+            send(fd, full, strlen(full), MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+        if ((size_t)fd >= srv.sessions.size()) {
+            size_t old_size = srv.sessions.size();
+            srv.sessions.resize(fd + 1);
+            for (size_t i = old_size; i < srv.sessions.size(); i++) srv.sessions[i].fd = -1;
+        }
+        if (!watch(srv, fd, EPOLLIN)) {
+            close(fd);
+            continue;
+        }
+        struct ucred credentials;
+        socklen_t length = sizeof(credentials);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) credentials.uid = (uid_t)-1;
+        session &s = srv.sessions[fd];
+        s.fd = fd;
+        s.peer = credentials.uid;
+        s.serial = srv.next_serial++;
+        s.authenticated = false;
+        s.verifying = false;
+        s.hung_up = false;
+        s.login_failures = 0;
+        s.vehicle = -1;
+        s.commands_this_tick = 0;
+        s.events = EPOLLIN;
+        s.closing = false;
+        s.dropped = 0;
+        s.output_sent = 0;
+        srv.session_count++;
+        srv.sessions_served++;
+    }
+}
+
+int format_status(char *line, size_t size, long vehicle, const telemetry_record &r) {
+    const status_struct &st = r.status;
+    return snprintf(line, size,
+                    "status %ld tick %llu speed %.2f gear %s lane %d/%d front %.0f behind %.0f light %.0f"
+                    " cc %d wipers %d cars %d%d%d%d lane_warning %d headlights %d rear_view %d turn %d\n",
+                    vehicle, (unsigned long long)r.tick, r.velocity,
+                    st.gear >= 0 && st.gear <= 3 ? gear_names[st.gear] : "?", st.lane, st.num_lanes,
+                    r.distance_in_front, r.distance_behind, r.light_level, st.cruise_control_active,
+                    st.wipers_on, st.cars_in_front, st.cars_in_back, st.cars_on_left, st.cars_on_right,
+                    st.lane_warning, st.headlights, st.rear_view, st.leftTurn ? -1 : st.rightTurn ? 1 : 0);
+}
+
+/* one fleet tick: drivers, then the operators' commands so theirs are the last word, then the status fan-out */
+void run_tick(server &srv) {
+    for (size_t i = 0; i < srv.vehicles.size(); i++) srv.vehicles[i].tick();
+    srv.drivers.runTick(srv.tick);
+    for (size_t i = 0; i < srv.queue.size(); i++) {
+        const InputCommand &command = srv.queue[i].command;
+        Planning &vehicle = srv.vehicles[srv.queue[i].vehicle];
+        if (command.menu == INPUT_ENVIRONMENT) vehicle.applyEnvironmentInput(command.code, command.value);
+        else vehicle.applyVehicleInput(command.code, command.value);
+    }
+    srv.queue.clear();
+    for (size_t i = 0; i < srv.vehicles.size(); i++) {
+        srv.vehicles[i].updateDisplay();
+        srv.vehicles[i].endTick();
+        tickArena.reset();
+    }
+    srv.tick++;
+
+    char line[MAX_LINE];
+    for (size_t fd = 0; fd < srv.sessions.size(); fd++) {
+        session &s = srv.sessions[fd];
+        if (s.fd < 0) continue;
+        s.commands_this_tick = 0;
+        if (s.vehicle < 0 || s.closing) continue;
+        if (s.output.size() - s.output_sent > MAX_QUEUED_OUTPUT) {
+            s.dropped++;
+            continue;
+        }
+        int length = format_status(line, sizeof(line), s.vehicle, srv.vehicles[s.vehicle].getLastRecord());
+        if (length > 0) s.output.append(line, min((size_t)length, sizeof(line) - 1));
+        flush_session(srv, s);
+    }
+}
+
+/* binds the socket, replacing it only if nothing answers on it */
+int listen_on(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        cout << "Socket path too long: " << path << endl;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        cout << "A server is already listening on " << path << endl;
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+
+    mode_t old_mask = umask(0117);      // operators in the socket's group only
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, 128) != 0 || !set_nonblocking(fd)) {
+        cout << "Cannot listen on " << path << ": " << strerror(errno) << endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 2) {
+        cout << "usage: alsetd <socket path> --credentials <store> [--fleet N] [--driver mixed|kind]"
+             << " [--tick-ms N] [--max-sessions N]" << endl;
+        return 2;
+    }
+
+    const char *socket_path = argv[1];
+    const char *credentials_path = NULL;
+    const char *driver_name = NULL;
+    long fleet_size = 16;
+    long tick_ms = (long)(1000 / Planning::TICKS_PER_SECOND);
+    long max_sessions = 1024;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--credentials") == 0 && i + 1 < argc) {
+            credentials_path = argv[++i];
+        } else if (strcmp(argv[i], "--driver") == 0 && i + 1 < argc) {
+            driver_name = argv[++i];
+        } else if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc) {
+            fleet_size = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--tick-ms") == 0 && i + 1 < argc) {
+            tick_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--max-sessions") == 0 && i + 1 < argc) {
+            max_sessions = atol(argv[++i]);
+        } else {
+            cout << "Unknown option " << argv[i] << endl;
+            return 2;
+        }
+    }
+    if (fleet_size <= 0 || tick_ms <= 0 || max_sessions <= 0) {
+        cout << "--fleet, --tick-ms and --max-sessions must be positive" << endl;
+        return 2;
+    }
+
+    server srv;
+    // operators log in over the socket, so only a real store will do, never the built-in accounts
+    if (credentials_path == NULL || !srv.store.open(credentials_path)) {
+        cout << "Could not open credential store " << (credentials_path != NULL ? credentials_path : "(none given)")
+             << endl;
+        return 1;
+    }
+
+    int driver_kind = -1;
+    if (driver_name != NULL && strcmp(driver_name, "mixed") != 0) {
+        driver_kind = driverKind(driver_name);
+        if (driver_kind < 0) {
+            cout << "Unknown driver " << driver_name << ", expected mixed";
+            for (int i = 0; i < DRIVER_KINDS; i++) cout << ", " << driverKindNames[i];
+            cout << endl;
+            return 1;
+        }
+    }
+    srv.vehicles.resize(fleet_size);
+    if (driver_name != NULL) {
+        for (long i = 0; i < fleet_size; i++) {
+            int kind = driver_kind >= 0 ? driver_kind : i % DRIVER_KINDS;
+            srv.drivers.spawn(srv.vehicles[i], makeDriver(kind, srv.vehicles[i], (uint32_t)(i + 1) * 2654435761u));
+        }
+    }
+
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    srv.listen_fd = listen_on(socket_path);
+    if (srv.listen_fd < 0) return 1;
+    srv.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    srv.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    srv.signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct itimerspec period;
+    period.it_interval.tv_sec = tick_ms / 1000;
+    period.it_interval.tv_nsec = (tick_ms % 1000) * 1000000;
+    period.it_value = period.it_interval;
+    if (srv.epoll_fd < 0 || srv.timer_fd < 0 || srv.signal_fd < 0 || timerfd_settime(srv.timer_fd, 0, &period, NULL) != 0
+        || !srv.verifier.start(srv.store) || !watch(srv, srv.listen_fd, EPOLLIN) || !watch(srv, srv.timer_fd, EPOLLIN)
+        || !watch(srv, srv.signal_fd, EPOLLIN) || !watch(srv, srv.verifier.get_notify_fd(), EPOLLIN)) {
+        cout << "Cannot start the event loop: " << strerror(errno) << endl;
+        unlink(socket_path);
+        return 1;
+    }
+    srv.max_sessions = max_sessions;
+    srv.session_count = 0;
+    srv.sessions_served = 0;
+    srv.next_serial = 0;
+    srv.pending_logins = 0;
+    srv.tick = 0;
+
+    cout << "Serving " << fleet_size << " vehicles on " << socket_path << ", a tick every " << tick_ms << " ms" << endl;
+
+    struct epoll_event events[64];
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(srv.epoll_fd, events, 64, -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == srv.listen_fd) {
+                accept_sessions(srv);
+            } else if (fd == srv.timer_fd) {
+                uint64_t expirations;
+                // a late wakeup runs one tick rather than a burst, the fleet slows down instead of jumping
+                if (read(srv.timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) run_tick(srv);
+            } else if (fd == srv.verifier.get_notify_fd()) {
+                uint64_t finished;
+                if (read(fd, &finished, sizeof(finished)) == sizeof(finished)) {
+                    login_request result;
+                    while (srv.verifier.take(result)) finish_login(srv, result);
+                }
+            } else if (fd == srv.signal_fd) {
+                running = false;
+            } else if ((size_t)fd < srv.sessions.size() && srv.sessions[fd].fd == fd) {
+                session &s = srv.sessions[fd];
+                if (events[i].events & EPOLLIN) read_session(srv, s);
+                else if (events[i].events & (EPOLLERR | EPOLLHUP)) close_session(srv, s);
+                else if (events[i].events & EPOLLOUT) flush_session(srv, s);
+            }
+        }
+    }
+
+    for (size_t fd = 0; fd < srv.sessions.size(); fd++) {
+        if (srv.sessions[fd].fd >= 0) close_session(srv, srv.sessions[fd]);
+    }
+    close(srv.listen_fd);
+    unlink(socket_path);
+    cout << srv.tick << " ticks, " << srv.sessions_served << " sessions served" << endl;
+    return 0;
+}
@@ -0,0 +1,307 @@
+#ifndef CREDENTIALS_HPP
+#define CREDENTIALS_HPP
+
+#include <stdint.h>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Operator credential store: a prebuilt file that is mmap'd at startup, so opening it costs the
+   same for 4 accounts or 100k. Passwords are kept as PBKDF2-HMAC-SHA256 over a per-account salt,
+   and accounts are found through a hash-and-displace perfect hash, one probe per lookup.
+
+   layout: credential_header, uint32_t displacement[bucket_count], credential_record[table_size] */
+
+static const uint32_t CREDENTIAL_MAGIC = 0x414c5343;    // "ALSC"
+static const uint32_t CREDENTIAL_VERSION = 2;
+static const uint32_t CREDENTIAL_ITERATIONS = 10000;    // PBKDF2 rounds for new accounts, credtool can raise it
+
+struct credential_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;           // accounts in the store
+    uint32_t table_size;      // record slots, unused ones have an empty username
+    uint32_t bucket_count;    // displacement buckets
+    uint32_t seed;
+};
+
+struct credential_record {
+    char username[32];
+    char full_name[64];
+    uint8_t salt[16];
+    uint8_t hash[32];         // PBKDF2-HMAC-SHA256(password, salt, iterations)
+    uint32_t iterations;
+    uint32_t unused;
+};
+
+
+/* SHA-256, FIPS 180-4 */
+
+class Sha256 {
+
+    private:
+
+    uint32_t state[8];
+    uint8_t block[64];
+    uint64_t length;      // bytes hashed so far
+    size_t used;          // bytes waiting in block
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress() {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16
+                 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+    public:
+
+    Sha256() {
+        static const uint32_t initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        memcpy(state, initial, sizeof(state));
+        length = 0;
+        used = 0;
+    }
+
+    void update(const void *data, size_t size) {
+        const uint8_t *bytes = (const uint8_t *)data;
+        length += size;
+        while (size > 0) {
+            size_t n = 64 - used < size ? 64 - used : size;
+            memcpy(block + used, bytes, n);
+            used += n;
+            bytes += n;
+            size -= n;
+            if(used == 64) {
+                compress();
+                used = 0;
+            }
+        }
+    }
+
+    void finish(uint8_t digest[32]) {
+        uint64_t bits = length * 8;
+        block[used++] = 0x80;
+        if(used > 56) {
+            memset(block + used, 0, 64 - used);
+            compress();
+            used = 0;
+        }
+        memset(block + used, 0, 56 - used);
+        for (int i = 0; i < 8; i++) block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+        compress();
+        for (int i = 0; i < 8; i++) {
+            digest[i * 4] = (uint8_t)(state[i] >> 24);
+            digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+            digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+            digest[i * 4 + 3] = (uint8_t)state[i];
+        }
+    }
+
+};
+
+/* HMAC-SHA256 with the key's pads hashed once, so every further message costs two compressions */
+
+class HmacSha256 {
+
+    private:
+
+    Sha256 inner;
+    Sha256 outer;
+
+    public:
+
+    HmacSha256(const void *key, size_t size) {
+        uint8_t block[64];
+        memset(block, 0, sizeof(block));
+        if(size > sizeof(block)) {
+            Sha256 shortened;
+            shortened.update(key, size);
+            shortened.finish(block);
+        } else {
+            memcpy(block, key, size);
+        }
+        uint8_t pad[64];
+        for (int i = 0; i < 64; i++) pad[i] = block[i] ^ 0x36;
+        inner.update(pad, sizeof(pad));
+        for (int i = 0; i < 64; i++) pad[i] = block[i] ^ 0x5c;
+        outer.update(pad, sizeof(pad));
+    }
+
+    /* digest may be the message itself */
+    void mac(const void *message, size_t size, uint8_t digest[32]) const {
+        uint8_t innerDigest[32];
+        Sha256 sha = inner;
+        sha.update(message, size);
+        sha.finish(innerDigest);
+        sha = outer;
+        sha.update(innerDigest, sizeof(innerDigest));
+        sha.finish(digest);
+    }
+
+};
+
+/* PBKDF2-HMAC-SHA256, RFC 8018, one 32-byte block */
+inline void hashPassword(const uint8_t salt[16], const char *password, uint32_t iterations, uint8_t digest[32]) {
+    HmacSha256 hmac(password, strlen(password));
+    uint8_t first[20];
+    memcpy(first, salt, 16);
+    first[16] = 0;
+    first[17] = 0;
+    first[18] = 0;
+    first[19] = 1;
+    uint8_t u[32];
+    hmac.mac(first, sizeof(first), u);
+    memcpy(digest, u, sizeof(u));
+    for (uint32_t i = 1; i < iterations; i++) {
+        hmac.mac(u, sizeof(u), u);
+        for (int k = 0; k < 32; k++) digest[k] ^= u[k];
+    }
+}
+
+
+/* perfect hash: bucket from the high half of the key hash, slot = (h1 + d * h2) % table_size */
+
+inline uint64_t credentialKeyHash(const char *key, uint32_t seed) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    for (; *key != '\0'; key++) {
+        h ^= (uint8_t)*key;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint32_t credentialBucket(uint64_t h, uint32_t bucketCount) { return (uint32_t)((h >> 32) % bucketCount); }
+
+inline uint32_t credentialSlot(uint64_t h, uint32_t displacement, uint32_t tableSize) {
+    uint64_t h1 = (uint32_t)h;
+    uint64_t h2 = ((h >> 17) | 1);
+    return (uint32_t)((h1 + displacement * h2) % tableSize);
+}
+
+
+class CredentialStore {
+
+    private:
+
+    void *mapping;
+    size_t mappedBytes;
+    const credential_header *header;
+    const uint32_t *displacement;
+    const credential_record *records;
+
+    public:
+
+    CredentialStore() {
+        mapping = NULL;
+        mappedBytes = 0;
+        header = NULL;
+        displacement = NULL;
+        records = NULL;
+    }
+
+    ~CredentialStore() { if(mapping != NULL) munmap(mapping, mappedBytes); }
+
+    bool open(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(credential_header)) {
+            ::close(fd);
+            return false;
+        }
+        void *memory = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(memory == MAP_FAILED) return false;
+
+        const credential_header *h = (const credential_header *)memory;
+        size_t expected = sizeof(credential_header) + (size_t)h->bucket_count * sizeof(uint32_t)
+                        + (size_t)h->table_size * sizeof(credential_record);
+        if(h->magic != CREDENTIAL_MAGIC || h->version != CREDENTIAL_VERSION || h->bucket_count == 0
+           || h->table_size == 0 || expected != (size_t)st.st_size) {
+            munmap(memory, st.st_size);
+            return false;
+        }
+        mapping = memory;
+        mappedBytes = st.st_size;
+        header = h;
+        displacement = (const uint32_t *)(header + 1);
+        records = (const credential_record *)(displacement + header->bucket_count);
+        return true;
+    }
+
+    bool isOpen() const { return mapping != NULL; }
+
+    uint32_t size() const { return header != NULL ? header->count : 0; }
+
+    /* PBKDF2 rounds of the first account, credtool gives every account in a store the same */
+    uint32_t iterations() const {
+        for (uint32_t i = 0; header != NULL && i < header->table_size; i++) {
+            if(records[i].username[0] != '\0') return records[i].iterations;
+        }
+        return CREDENTIAL_ITERATIONS;
+    }
+
+    /* the account's record, or NULL if there is no such user */
+    const credential_record *find(const char *username) const {
+        // empty slots have an empty username, so it must never match one
+        if(header == NULL || username[0] == '\0' || strlen(username) >= sizeof(records->username)) return NULL;
+        uint64_t h = credentialKeyHash(username, header->seed);
+        uint32_t d = displacement[credentialBucket(h, header->bucket_count)];
+        const credential_record *record = &records[credentialSlot(h, d, header->table_size)];
+        if(strncmp(record->username, username, sizeof(record->username)) != 0) return NULL;
+        return record;
+    }
+
+    static bool verify(const credential_record *record, const char *password) {
+        if(record->iterations == 0) return false;
+        uint8_t digest[32];
+        hashPassword(record->salt, password, record->iterations, digest);
+        uint8_t difference = 0;
+        for (int i = 0; i < 32; i++) difference |= digest[i] ^ record->hash[i];
+        return difference == 0;
+    }
+
+};
+
+#endif
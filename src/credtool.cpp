@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "credentials.hpp"
+
+using namespace std;
+
+/* Builds the operator credential store read by system --credentials.
+   Input has one account per line: username:password:Full Name. Passwords get
+   CREDENTIAL_ITERATIONS PBKDF2 rounds unless --iterations asks for more or fewer. */
+
+struct account {
+    string username;
+    string password;
+    string full_name;
+};
+
+bool read_accounts(const char *path, vector<account> &accounts) {
+    ifstream in(path);
+    if (!in) return false;
+    string line;
+    int line_number = 0;
+    while (getline(in, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') continue;
+        size_t first = line.find(':');
+        size_t second = first == string::npos ? string::npos : line.find(':', first + 1);
+        if (second == string::npos) {
+            cout << path << ":" << line_number << ": expected username:password:Full Name" << endl;
+            return false;
+        }
+        account a;
+        a.username = line.substr(0, first);
+        a.password = line.substr(first + 1, second - first - 1);
+        a.full_name = line.substr(second + 1);
+        if (a.username.empty() || a.username.size() >= sizeof(((credential_record *)0)->username)
+            || a.full_name.size() >= sizeof(((credential_record *)0)->full_name)) {
+            cout << path << ":" << line_number << ": username or full name too long" << endl;
+            return false;
+        }
+        accounts.push_back(a);
+    }
+    return true;
+}
+
+/* finds a displacement per bucket so every account lands in its own slot, false if this seed doesn't work */
+bool place(const vector<account> &accounts, uint32_t seed, uint32_t table_size, uint32_t bucket_count,
+           vector<uint32_t> &displacement, vector<int> &slot_owner) {
+    vector<vector<int>> buckets(bucket_count);
+    vector<uint64_t> hashes(accounts.size());
+    for (size_t i = 0; i < accounts.size(); i++) {
+        hashes[i] = credentialKeyHash(accounts[i].username.c_str(), seed);
+        buckets[credentialBucket(hashes[i], bucket_count)].push_back(i);
+    }
+    vector<uint32_t> order(bucket_count);
+    for (uint32_t b = 0; b < bucket_count; b++) order[b] = b;
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    displacement.assign(bucket_count, 0);
+    slot_owner.assign(table_size, -1);
+    vector<uint32_t> slots;
+    for (uint32_t b : order) {
+        if (buckets[b].empty()) break;
+        bool placed = false;
+        for (uint32_t d = 0; d < table_size * 4 && !placed; d++) {
+            slots.clear();
+            placed = true;
+            for (int i : buckets[b]) {
+                uint32_t slot = credentialSlot(hashes[i], d, table_size);
+                if (slot_owner[slot] != -1 || find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    placed = false;
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (placed) {
+                displacement[b] = d;
+                for (size_t k = 0; k < slots.size(); k++) slot_owner[slots[k]] = buckets[b][k];
+            }
+        }
+        if (!placed) return false;
+    }
+    return true;
+}
+
+/* hashes every account's password on all cores, the salts are already in the records */
+void hash_passwords(const vector<account> &accounts, const vector<int> &slot_owner, vector<credential_record> &records) {
+    atomic<uint32_t> next(0);
+    auto work = [&]() {
+        uint32_t slot;
+        while ((slot = next.fetch_add(1)) < records.size()) {
+            if (slot_owner[slot] < 0) continue;
+            credential_record &r = records[slot];
+            hashPassword(r.salt, accounts[slot_owner[slot]].password.c_str(), r.iterations, r.hash);
+        }
+    };
+    unsigned count = thread::hardware_concurrency();
+    vector<thread> workers;
+    for (unsigned i = 1; i < count; i++) workers.push_back(thread(work));
+    work();
+    for (thread &t : workers) t.join();
+}
+
+int build(const char *input, const char *output, uint32_t iterations) {
+    vector<account> accounts;
+    if (!read_accounts(input, accounts)) return 1;
+    vector<string> names;
+    for (const account &a : accounts) names.push_back(a.username);
+    sort(names.begin(), names.end());
+    if (adjacent_find(names.begin(), names.end()) != names.end()) {
+        cout << "duplicate username " << *adjacent_find(names.begin(), names.end()) << endl;
+        return 1;
+    }
+
+    credential_header header;
+    header.magic = CREDENTIAL_MAGIC;
+    header.version = CREDENTIAL_VERSION;
+    header.count = accounts.size();
+    header.table_size = accounts.size() + accounts.size() / 4 + 1;
+    header.bucket_count = accounts.size() / 3 + 1;
+
+    vector<uint32_t> displacement;
+    vector<int> slot_owner;
+    bool found = false;
+    for (header.seed = 1; header.seed < 1000 && !found; header.seed++) {
+        found = place(accounts, header.seed, header.table_size, header.bucket_count, displacement, slot_owner);
+        if (found) break;
+    }
+    if (!found) {
+        cout << "could not build a perfect hash for these accounts" << endl;
+        return 1;
+    }
+
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom == NULL) {
+        cout << "could not open /dev/urandom" << endl;
+        return 1;
+    }
+    vector<credential_record> records(header.table_size);
+    memset(records.data(), 0, records.size() * sizeof(credential_record));
+    for (uint32_t slot = 0; slot < header.table_size; slot++) {
+        if (slot_owner[slot] < 0) continue;
+        const account &a = accounts[slot_owner[slot]];
+        credential_record &r = records[slot];
+        strncpy(r.username, a.username.c_str(), sizeof(r.username) - 1);
+        strncpy(r.full_name, a.full_name.c_str(), sizeof(r.full_name) - 1);
+        if (fread(r.salt, 1, sizeof(r.salt), urandom) != sizeof(r.salt)) {
+            cout << "could not read /dev/urandom" << endl;
+            fclose(urandom);
+            return 1;
+        }
+        r.iterations = iterations;
+    }
+    fclose(urandom);
+    hash_passwords(accounts, slot_owner, records);
+
+    FILE *out = fopen(output, "wb");
+    if (out == NULL) {
+        cout << "could not write " << output << endl;
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(displacement.data(), sizeof(uint32_t), displacement.size(), out);
+    fwrite(records.data(), sizeof(credential_record), records.size(), out);
+    fclose(out);
+    cout << header.count << " accounts written to " << output << endl;
+    return 0;
+}
+
+int check(const char *store_path, const char *username, const char *password) {
+    CredentialStore store;
+    if (!store.open(store_path)) {
+        cout << "could not open " << store_path << endl;
+        return 2;
+    }
+    const credential_record *record = store.find(username);
+    if (record == NULL) {
+        cout << "Invalid username." << endl;
+        return 1;
+    }
+    if (!CredentialStore::verify(record, password)) {
+        cout << "Invalid password." << endl;
+        return 1;
+    }
+    cout << record->full_name << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 4 && strcmp(argv[1], "build") == 0) return build(argv[2], argv[3], CREDENTIAL_ITERATIONS);
+    if (argc == 6 && strcmp(argv[1], "build") == 0 && strcmp(argv[2], "--iterations") == 0) {
+        char *end;
+        unsigned long iterations = strtoul(argv[3], &end, 10);
+        if (*end != '\0' || iterations == 0 || iterations > UINT32_MAX) {
+            cout << "--iterations must be a positive number of PBKDF2 rounds" << endl;
+            return 2;
+        }
+        return build(argv[4], argv[5], (uint32_t)iterations);
+    }
+    if (argc == 5 && strcmp(argv[1], "check") == 0) return check(argv[2], argv[3], argv[4]);
+    cout << "usage: credtool build [--iterations N] <accounts.txt> <store>" << endl;
+    cout << "       credtool check <store> <username> <password>" << endl;
+    return 2;
+}
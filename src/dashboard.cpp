@@ -0,0 +1,66 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+
+#include "status_ring.hpp"
+
+using namespace std;
+
+/* Reads the status ring a running simulator publishes with --publish-status.
+   Only maps the ring read-only, so any number of these can watch without slowing the simulator. */
+
+const char *gear_names[] = {"P", "R", "N", "D"};
+
+void print_entry(const status_entry &entry) {
+    const status_struct &s = entry.status;
+    cout << "tick " << entry.tick
+         << "  " << entry.velocity << " mph"
+         << "  gear " << (s.gear >= 0 && s.gear <= 3 ? gear_names[s.gear] : "?")
+         << "  lane " << s.lane
+         << "  front " << entry.distance_in_front
+         << "  behind " << entry.distance_behind
+         << "  light " << entry.light_level
+         << (s.cruise_control_active ? "  cc" : "")
+         << (s.wipers_on ? "  wipers" : "")
+         << (s.headlights == 2 ? "  highbeams" : s.headlights == 1 ? "  headlights" : "")
+         << (s.rear_view ? "  rearview" : "")
+         << endl;
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 2) {
+        cout << "usage: dashboard <shm name> [--history N]" << endl;
+        return 2;
+    }
+
+    StatusRingReader ring;
+    if (!ring.open(argv[1])) {
+        cout << "No status ring at " << argv[1] << endl;
+        return 1;
+    }
+
+    if (argc >= 4 && strcmp(argv[2], "--history") == 0) {
+        uint64_t wanted = strtoull(argv[3], NULL, 10);
+        uint64_t next = ring.published();
+        uint64_t first = next > wanted ? next - wanted : 0;
+        status_entry entry;
+        for (uint64_t i = first; i < next; i++) {
+            if (ring.read(i, entry)) print_entry(entry);
+        }
+        return 0;
+    }
+
+    uint64_t shown = 0;
+    while (true) {
+        uint64_t next = ring.published();
+        status_entry entry;
+        if (next > shown && ring.readLatest(entry)) {
+            print_entry(entry);
+            shown = next;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
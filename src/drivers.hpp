@@ -0,0 +1,380 @@
+#ifndef DRIVERS_HPP
+#define DRIVERS_HPP
+
+#include <coroutine>
+#include <exception>
+#include <vector>
+
+#include "scenario.hpp"
+
+/* Driver agents
+
+   A driver is a coroutine that co_awaits ticks or conditions on its vehicle and issues the same
+   commands as the vehicle menu. The scheduler keeps sleeping drivers in a timer wheel and
+   waiting ones on a condition list it checks itself, so a driver is only resumed when its wake
+   condition fired. Frames come from a per-thread pool; drivers must be spawned, run and
+   destroyed on the same thread. */
+
+
+/* free lists of 64-byte size classes, carved from 64KB slabs that are kept until thread exit */
+
+class FramePool {
+
+    private:
+
+    static const size_t GRANULE = 64;
+    static const size_t CLASSES = 16;           // pooled frames up to 1KB
+    static const size_t SLAB_BYTES = 64 * 1024;
+
+    void *freeList[CLASSES];
+    std::vector<char *> slabs;
+    char *cursor;
+    size_t remaining;
+
+    public:
+
+    FramePool() {
+        for (size_t i = 0; i < CLASSES; i++) freeList[i] = NULL;
+        cursor = NULL;
+        remaining = 0;
+    }
+
+    ~FramePool() { for (size_t i = 0; i < slabs.size(); i++) ::operator delete(slabs[i]); }
+
+    void *allocate(size_t size) {
+        size_t c = (size + GRANULE - 1) / GRANULE - 1;
+        if(c >= CLASSES) return ::operator new(size);
+        if(freeList[c] != NULL) {
+            void *frame = freeList[c];
+            freeList[c] = *(void **)frame;
+            return frame;
+        }
+        size_t bytes = (c + 1) * GRANULE;
+        if(remaining < bytes) {
+            cursor = (char *)::operator new(SLAB_BYTES);
+            slabs.push_back(cursor);
+            remaining = SLAB_BYTES;
+        }
+        void *frame = cursor;
+        cursor += bytes;
+        remaining -= bytes;
+        return frame;
+    }
+
+    void release(void *frame, size_t size) {
+        size_t c = (size + GRANULE - 1) / GRANULE - 1;
+        if(c >= CLASSES) {
+            ::operator delete(frame);
+            return;
+        }
+        *(void **)frame = freeList[c];
+        freeList[c] = frame;
+    }
+
+    size_t getReservedBytes() const { return slabs.size() * SLAB_BYTES; }
+
+};
+
+thread_local FramePool driverFrames;
+
+
+class DriverScheduler;
+
+/* the coroutine type every driver returns */
+class DriverTask {
+
+    public:
+
+    struct promise_type {
+        DriverScheduler *scheduler;
+        Planning *vehicle;
+        promise_type *next;              // link in the timer wheel, condition list or ready list
+        uint64_t wake;                   // tick to resume at while sleeping
+        ScenarioInstruction condition;   // what to wait for while on the condition list
+
+        static void *operator new(size_t size) { return driverFrames.allocate(size); }
+        static void operator delete(void *frame, size_t size) { driverFrames.release(frame, size); }
+
+        DriverTask get_return_object() { return DriverTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    DriverTask(DriverTask &&other) : handle(other.handle) { other.handle = NULL; }
+
+    ~DriverTask() { if(handle) handle.destroy(); }
+
+    /* hands the coroutine over to a scheduler */
+    Handle release() {
+        Handle h = handle;
+        handle = NULL;
+        return h;
+    }
+
+    private:
+
+    Handle handle;
+
+    explicit DriverTask(Handle h) : handle(h) {}
+
+};
+
+
+class DriverScheduler : public TickInputs {
+
+    private:
+
+    typedef DriverTask::promise_type Agent;
+
+    static const size_t WHEEL_SIZE = 256;    // longer sleeps go round the wheel again
+
+    Agent *wheel[WHEEL_SIZE];
+    Agent *waiting;         // condition waiters
+    Agent *ready;           // resumed in spawn / wake order
+    Agent *readyTail;
+    uint64_t now;           // tick being run
+    bool started;
+    size_t live;
+    unsigned long resumes;
+
+    void pushReady(Agent *agent) {
+        agent->next = NULL;
+        if(readyTail != NULL) readyTail->next = agent;
+        else ready = agent;
+        readyTail = agent;
+    }
+
+    static void destroyList(Agent *agent) {
+        while (agent != NULL) {
+            Agent *next = agent->next;
+            DriverTask::Handle::from_promise(*agent).destroy();
+            agent = next;
+        }
+    }
+
+    public:
+
+    DriverScheduler() {
+        for (size_t i = 0; i < WHEEL_SIZE; i++) wheel[i] = NULL;
+        waiting = NULL;
+        ready = NULL;
+        readyTail = NULL;
+        now = 0;
+        started = false;
+        live = 0;
+        resumes = 0;
+    }
+
+    ~DriverScheduler() {
+        for (size_t i = 0; i < WHEEL_SIZE; i++) destroyList(wheel[i]);
+        destroyList(waiting);
+        destroyList(ready);
+    }
+
+    /* the driver starts running on the next tick */
+    void spawn(Planning &vehicle, DriverTask task) {
+        Agent &agent = task.release().promise();
+        agent.scheduler = this;
+        agent.vehicle = &vehicle;
+        pushReady(&agent);
+        live++;
+    }
+
+    void sleep(Agent &agent, uint32_t ticks) {
+        agent.wake = now + ticks;
+        Agent *&slot = wheel[agent.wake % WHEEL_SIZE];
+        agent.next = slot;
+        slot = &agent;
+    }
+
+    void waitFor(Agent &agent, const ScenarioInstruction &condition) {
+        agent.condition = condition;
+        agent.next = waiting;
+        waiting = &agent;
+    }
+
+    uint64_t getTick() const { return now; }
+
+    size_t getLiveCount() const { return live; }
+
+    unsigned long getResumeCount() const { return resumes; }
+
+    /* call once per tick, after every driven vehicle ran tick() and before their endTick() */
+    void runTick(uint64_t tick) {
+        if(started && tick <= now) return;
+        started = true;
+        now = tick;
+
+        Agent **link = &wheel[tick % WHEEL_SIZE];
+        while (*link != NULL) {
+            Agent *agent = *link;
+            if(agent->wake <= tick) {
+                *link = agent->next;
+                pushReady(agent);
+            } else {
+                link = &agent->next;
+            }
+        }
+
+        link = &waiting;
+        while (*link != NULL) {
+            Agent *agent = *link;
+            if(conditionHolds(*agent->vehicle, agent->condition, tick)) {
+                *link = agent->next;
+                pushReady(agent);
+            } else {
+                link = &agent->next;
+            }
+        }
+
+        // drivers resumed here only queue on the wheel or condition list, never on ready
+        Agent *agent = ready;
+        ready = NULL;
+        readyTail = NULL;
+        while (agent != NULL) {
+            Agent *next = agent->next;
+            DriverTask::Handle handle = DriverTask::Handle::from_promise(*agent);
+            handle.resume();
+            resumes++;
+            if(handle.done()) {
+                handle.destroy();
+                live--;
+            }
+            agent = next;
+        }
+    }
+
+    /* single-vehicle use through Planning::addTickInputs */
+    void apply(Planning &vehicle) override { runTick(vehicle.getTickCount()); }
+
+};
+
+
+/* awaitables */
+
+struct TicksAwaiter {
+    uint32_t ticks;
+    bool await_ready() const { return ticks == 0; }
+    void await_suspend(DriverTask::Handle h) { h.promise().scheduler->sleep(h.promise(), ticks); }
+    void await_resume() const {}
+};
+
+struct ConditionAwaiter {
+    ScenarioInstruction condition;
+    bool await_ready() const { return false; }
+    bool await_suspend(DriverTask::Handle h) {
+        DriverTask::promise_type &agent = h.promise();
+        if(conditionHolds(*agent.vehicle, condition, agent.scheduler->getTick())) return false;
+        agent.scheduler->waitFor(agent, condition);
+        return true;
+    }
+    void await_resume() const {}
+};
+
+inline TicksAwaiter ticks(uint32_t n) { return TicksAwaiter{n}; }
+
+/* resumes on the first tick the condition holds, right away if it already does */
+inline ConditionAwaiter until(ScenarioVar var, ScenarioCmp cmp, int value) {
+    ConditionAwaiter waiter;
+    waiter.condition.op = OP_WAIT_COND;
+    waiter.condition.arg = var;
+    waiter.condition.cmp = cmp;
+    waiter.condition.unused = 0;
+    waiter.condition.value = value;
+    return waiter;
+}
+
+inline uint32_t driverRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+/* Behaviors, seed only varies speeds and reaction times */
+
+/* runs fast and signals out of any lane with traffic ahead, the other way if the first try fails */
+DriverTask aggressiveMerger(Planning &vehicle, uint32_t seed) {
+    uint32_t rng = seed | 1;
+    int cruise = 75 + driverRandom(rng) % 10;
+    vehicle.applyVehicleInput(2, cruise);
+    while (true) {
+        co_await until(VAR_FRONT, CMP_LT, 100);
+        int lane = vehicle.getLane();
+        vehicle.applyVehicleInput(4, lane > 1 ? -1 : 1);
+        co_await ticks(1);
+        if(vehicle.getLane() == lane) {
+            vehicle.applyVehicleInput(4, lane > 1 ? 1 : -1);
+            co_await ticks(1);
+        }
+        vehicle.applyVehicleInput(2, cruise + 5);
+        co_await ticks(3 + driverRandom(rng) % 5);
+    }
+}
+
+/* closes every gap: as soon as it is braked below its speed it accelerates straight back */
+DriverTask tailgater(Planning &vehicle, uint32_t seed) {
+    uint32_t rng = seed | 1;
+    int cruise = 70 + driverRandom(rng) % 10;
+    vehicle.applyVehicleInput(2, cruise);
+    while (true) {
+        co_await until(VAR_SPEED, CMP_LT, cruise - 5);
+        co_await ticks(1 + driverRandom(rng) % 2);
+        vehicle.applyVehicleInput(2, cruise);
+    }
+}
+
+/* drives under the limit, slows down further in the rain and waits a while before speeding up */
+DriverTask timidDriver(Planning &vehicle, uint32_t seed) {
+    uint32_t rng = seed | 1;
+    int cruise = 45 + driverRandom(rng) % 10;
+    vehicle.applyVehicleInput(1, cruise);
+    while (true) {
+        co_await until(VAR_RAIN, CMP_EQ, 1);
+        vehicle.applyVehicleInput(1, cruise - 15);
+        co_await until(VAR_RAIN, CMP_EQ, 0);
+        co_await ticks(5 + driverRandom(rng) % 10);
+        vehicle.applyVehicleInput(2, cruise);
+    }
+}
+
+/* keeps its speed and moves one lane over and back every so often */
+DriverTask commuter(Planning &vehicle, uint32_t seed) {
+    uint32_t rng = seed | 1;
+    int cruise = 60 + driverRandom(rng) % 6;
+    vehicle.applyVehicleInput(2, cruise);
+    while (true) {
+        co_await ticks(20 + driverRandom(rng) % 20);
+        vehicle.applyVehicleInput(4, vehicle.getLane() > 1 ? -1 : 1);
+        co_await ticks(1);
+        if(vehicle.getSpeed() < cruise - 5) vehicle.applyVehicleInput(2, cruise);
+    }
+}
+
+enum DriverKind { DRIVER_AGGRESSIVE, DRIVER_TAILGATER, DRIVER_TIMID, DRIVER_COMMUTER, DRIVER_KINDS };
+
+static const char *driverKindNames[DRIVER_KINDS] = {"aggressive", "tailgater", "timid", "commuter"};
+
+/* the kind with that name, or -1 */
+inline int driverKind(const char *name) {
+    for (int i = 0; i < DRIVER_KINDS; i++) {
+        if(strcmp(name, driverKindNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+inline DriverTask makeDriver(int kind, Planning &vehicle, uint32_t seed) {
+    switch(kind) {
+        case DRIVER_AGGRESSIVE: return aggressiveMerger(vehicle, seed);
+        case DRIVER_TAILGATER: return tailgater(vehicle, seed);
+        case DRIVER_TIMID: return timidDriver(vehicle, seed);
+        default: return commuter(vehicle, seed);
+    }
+}
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef INPUTLOG_HPP
+#define INPUTLOG_HPP
+
+#include <stdint.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "vehicle.cpp"
+
+/* Input logs
+
+   Recorded menu inputs, one per line, with the same codes as the environment and vehicle menus:
+
+       # tick menu code [value]
+       0 V 3 3          # drive
+       2 V 2 70         # accelerate to 70
+       30 E 1 15        # car 15 ahead
+
+   Ticks never go backwards, the value defaults to 0, '#' starts a comment. The file is mapped
+   rather than read and parsed in batches, so a log of any size streams through a fixed buffer;
+   newlines and digit runs are found 16 bytes at a time where SSE2 is available. */
+
+enum InputMenu { INPUT_ENVIRONMENT, INPUT_VEHICLE };
+
+struct InputCommand {
+    uint64_t tick;
+    int32_t value;
+    uint8_t menu;       // InputMenu
+    uint8_t code;
+    uint16_t unused;
+};
+
+class InputLog {
+
+    private:
+
+    static const size_t RELEASE_BYTES = 64 << 20;    // parsed pages are dropped this far behind
+
+    const char *data;
+    const char *cursor;
+    const char *end;
+    const char *lineStart;
+    const char *released;
+    size_t mappedBytes;
+    uint64_t line;
+    uint64_t lastTick;
+    uint64_t commands;
+    std::string error;
+
+    /* kept out of line so the parsing paths stay small enough to inline */
+    __attribute__((noinline, cold, format(printf, 3, 4)))
+    bool fail(const char *at, const char *format, ...) {
+        char message[160];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+        error = std::to_string(line) + ":" + std::to_string(at - lineStart + 1) + ": " + message;
+        return false;
+    }
+
+    static bool isDigit(char c) { return (unsigned char)(c - '0') < 10; }
+
+    static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    /* length of the digit run at p */
+    size_t digitRun(const char *p) const {
+        size_t n = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9);
+        while (end - (p + n) >= 16) {
+            __m128i bytes = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)(p + n)), zero);
+            // unsigned bytes - '0' <= 9 exactly for digits
+            unsigned digits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(bytes, nine), nine));
+            if(digits != 0xffff) return n + __builtin_ctz(~digits);
+            n += 16;
+        }
+#endif
+        while (p + n < end && isDigit(p[n])) n++;
+        return n;
+    }
+
+    /* first newline at or after p, or end */
+    const char *lineEnd(const char *p) const {
+#if defined(__SSE2__)
+        const __m128i newline = _mm_set1_epi8('\n');
+        while (end - p >= 16) {
+            unsigned hits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), newline));
+            if(hits != 0) return p + __builtin_ctz(hits);
+            p += 16;
+        }
+#endif
+        while (p < end && *p != '\n') p++;
+        return p;
+    }
+
+    const char *skipBlanks(const char *p) const {
+        while (p < end && isBlank(*p)) p++;
+        return p;
+    }
+
+    /* the value of n <= 8 digits at p, with 8 bytes readable there: shifted so the run ends in
+       the top byte, the bytes before it become leading zeros */
+    static uint64_t eightDigits(const char *p, size_t n) {
+        uint64_t digits;
+        memcpy(&digits, p, 8);
+        digits = ((digits & 0x0f0f0f0f0f0f0f0fULL) << (8 * (8 - n))) * 2561 >> 8;
+        digits = (digits & 0x00ff00ff00ff00ffULL) * 6553601 >> 16;
+        return (digits & 0x0000ffff0000ffffULL) * 42949672960001ULL >> 32;
+    }
+
+    /* an unsigned number of at most 19 digits at p, advances p past it */
+    bool number(const char *&p, uint64_t &value, const char *what) {
+        size_t n = digitRun(p);
+        if(n == 0) {
+            if(p == end || *p == '\n' || *p == '#') return fail(p, "expected a %s", what);
+            return fail(p, "expected a %s, found '%c'", what, *p);
+        }
+        if(n > 19) return fail(p, "%s out of range", what);
+        if(n <= 8 && end - p >= 8) {
+            value = eightDigits(p, n);
+        } else {
+            value = 0;
+            for (size_t i = 0; i < n; i++) value = value * 10 + (uint64_t)(p[i] - '0');
+        }
+        p += n;
+        return true;
+    }
+
+#if defined(__SSE2__)
+    /* the common line in one pass over 32 bytes: single spaces, a tick and value of at most 8
+       digits, no comment. Returns false without parsing anything for every other line. */
+    bool quickLine(const char *p, InputCommand &command) {
+        if(end - p < 32) return false;
+        const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9), newline = _mm_set1_epi8('\n');
+        __m128i low = _mm_loadu_si128((const __m128i *)p), high = _mm_loadu_si128((const __m128i *)(p + 16));
+        uint32_t newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(low, newline))
+                          | (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(high, newline)) << 16;
+        low = _mm_sub_epi8(low, zero);
+        high = _mm_sub_epi8(high, zero);
+        uint32_t digits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(low, nine), nine))
+                        | (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(high, nine), nine)) << 16;
+        // a newline is not a digit, so once one is in the window ~digits has a bit set for ctz
+        if(newlines == 0) return false;
+        unsigned length = __builtin_ctz(newlines);
+        unsigned tickDigits = __builtin_ctz(~digits);
+        if(tickDigits == 0 || tickDigits > 8) return false;
+
+        // tick, space, menu, space, one-digit code
+        const char *m = p + tickDigits;
+        if(m[0] != ' ' || (m[1] != 'E' && m[1] != 'V') || m[2] != ' ' || !isDigit(m[3])) return false;
+        unsigned at = tickDigits + 4;
+        if(digits >> at & 1) return false;
+        uint8_t menu = m[1] == 'E' ? INPUT_ENVIRONMENT : INPUT_VEHICLE;
+        uint8_t code = m[3] - '0';
+        if(code > (menu == INPUT_ENVIRONMENT ? 5 : 4)) return false;
+
+        int32_t value = 0;
+        if(at != length) {
+            if(p[at] != ' ') return false;
+            bool negative = p[++at] == '-';
+            at += negative;
+            unsigned valueDigits = __builtin_ctz(~(digits >> at));
+            if(valueDigits == 0 || valueDigits > 8 || at + valueDigits != length) return false;
+            value = (int32_t)eightDigits(p + at, valueDigits);
+            if(negative) value = -value;
+        }
+        uint64_t tick = eightDigits(p, tickDigits);
+        if(tick < lastTick) return false;
+
+        command.tick = tick;
+        command.value = value;
+        command.menu = menu;
+        command.code = code;
+        command.unused = 0;
+        lastTick = tick;
+        cursor = p + length;
+        return true;
+    }
+#else
+    bool quickLine(const char *, InputCommand &) { return false; }
+#endif
+
+    /* one command from a line that isn't blank, cursor is left at the line's newline */
+    bool parseLine(const char *p, InputCommand &command) {
+        uint64_t tick, code, value = 0;
+        const char *start = p;
+        if(!number(p, tick, "tick")) return false;
+        if(tick < lastTick) return fail(start, "tick %llu is before tick %llu", (unsigned long long)tick, (unsigned long long)lastTick);
+
+        const char *field = skipBlanks(p);
+        if(field == p) return fail(p, "expected a space after the tick");
+        if(field == end || (*field != 'E' && *field != 'V')) return fail(field, "expected E or V");
+        command.menu = *field == 'E' ? INPUT_ENVIRONMENT : INPUT_VEHICLE;
+        p = field + 1;
+
+        field = skipBlanks(p);
+        if(field == p) return fail(p, "expected a space after the menu");
+        p = field;
+        if(!number(p, code, "code")) return false;
+        if(code > (command.menu == INPUT_ENVIRONMENT ? 5u : 4u)) {
+            return fail(field, "unknown %s code %llu", command.menu == INPUT_ENVIRONMENT ? "environment" : "vehicle",
+                        (unsigned long long)code);
+        }
+
+        field = skipBlanks(p);
+        bool negative = false;
+        if(field > p && field < end && (*field == '-' || isDigit(*field))) {
+            p = field;
+            negative = *p == '-';
+            if(negative) p++;
+            if(!number(p, value, "value")) return false;
+            if(value > (negative ? 2147483648ULL : 2147483647ULL)) return fail(field, "value out of range");
+            field = skipBlanks(p);
+        }
+        if(field < end && *field != '\n' && *field != '#') return fail(field, "unexpected '%c'", *field);
+
+        command.tick = tick;
+        command.code = (uint8_t)code;
+        command.value = negative ? (int32_t)(0 - value) : (int32_t)value;
+        command.unused = 0;
+        lastTick = tick;
+        cursor = field < end && *field == '\n' ? field : lineEnd(field);
+        return true;
+    }
+
+    public:
+
+    InputLog() {
+        data = cursor = end = lineStart = released = NULL;
+        mappedBytes = 0;
+        line = 0;
+        lastTick = 0;
+        commands = 0;
+    }
+
+    ~InputLog() { if(mappedBytes > 0) munmap((void *)data, mappedBytes); }
+
+    bool open(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0) {
+            error = "cannot read the file";
+            return false;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0) {
+            ::close(fd);
+            error = "cannot read the file";
+            return false;
+        }
+        mappedBytes = st.st_size;
+        if(mappedBytes > 0) {
+            void *mapping = mmap(NULL, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping == MAP_FAILED) {
+                ::close(fd);
+                mappedBytes = 0;
+                error = "cannot map the file";
+                return false;
+            }
+            madvise(mapping, mappedBytes, MADV_SEQUENTIAL);
+            data = (const char *)mapping;
+        }
+        ::close(fd);
+        cursor = lineStart = released = data;
+        end = data + mappedBytes;
+        line = 1;
+        return true;
+    }
+
+    /* parses up to capacity commands into out, stops before a bad line and returns 0 from then on */
+    size_t read(InputCommand *out, size_t capacity) {
+        if(!error.empty()) return 0;
+        size_t n = 0;
+        while (n < capacity && cursor < end) {
+            const char *p = skipBlanks(cursor);
+            if(quickLine(p, out[n])) {
+                n++;
+            } else if(p < end && *p != '\n') {
+                if(*p == '#') cursor = lineEnd(p);
+                else if(!parseLine(p, out[n])) break;
+                else n++;
+            } else {
+                cursor = p;
+            }
+            if(cursor < end) {
+                cursor++;
+                line++;
+                lineStart = cursor;
+            }
+        }
+        commands += n;
+
+        // the mapping is private and clean, dropping parsed pages keeps a huge log from filling memory
+        if((size_t)(cursor - released) >= RELEASE_BYTES) {
+            const char *upTo = data + ((cursor - data) & ~(size_t)(sysconf(_SC_PAGESIZE) - 1));
+            madvise((void *)released, upTo - released, MADV_DONTNEED);
+            released = upTo;
+        }
+        return n;
+    }
+
+    bool failed() const { return !error.empty(); }
+
+    /* "line:column: message" for the first bad line */
+    const std::string &getError() const { return error; }
+
+    uint64_t getCommandCount() const { return commands; }
+
+#ifdef PARSE_CHECK
+    /* on a log that was never opened: parses the first line of text, after a line for tick
+       previous, with the quick path and with parseLine. quick says whether the quick path took
+       the line; false if it did and parseLine reads it differently. */
+    bool quickPathAgrees(const char *text, size_t size, uint64_t previous, bool &quick) {
+        data = cursor = lineStart = released = text;
+        end = text + size;
+        line = 1;
+        error.clear();
+        InputCommand fast, careful;
+        lastTick = previous;
+        quick = quickLine(skipBlanks(text), fast);
+        if(!quick) return true;
+        const char *fastEnd = cursor;
+        lastTick = previous;
+        if(!parseLine(skipBlanks(text), careful)) return false;
+        return cursor == fastEnd && careful.tick == fast.tick && careful.menu == fast.menu
+            && careful.code == fast.code && careful.value == fast.value;
+    }
+#endif
+
+    size_t getParsedBytes() const { return cursor - data; }
+
+    size_t getSize() const { return mappedBytes; }
+
+};
+
+
+/* feeds a log's commands to a vehicle as its ticks come up, commands for earlier ticks go in the next one */
+
+class InputLogPlayer : public TickInputs {
+
+    private:
+
+    InputLog *log;
+    std::vector<InputCommand> batch;
+    size_t next;
+    size_t count;
+    const char *reportName;     // where to say the log stopped, NULL to leave it to the caller
+
+    /* an interactive run has no exit status to carry the error, so it goes on the terminal once */
+    void report(Planning &vehicle) {
+        vehicle.pauseRendering();
+        std::cout << reportName << ":" << log->getError() << std::endl;
+        vehicle.resumeRendering();
+        reportName = NULL;
+    }
+
+    public:
+
+    explicit InputLogPlayer(InputLog &source, size_t batchSize = 4096) : log(&source), batch(batchSize) {
+        next = 0;
+        count = 0;
+        reportName = NULL;
+    }
+
+    void reportFailureAs(const char *name) { reportName = name; }
+
+    void apply(Planning &vehicle) override {
+        uint64_t tick = vehicle.getTickCount();
+        while (true) {
+            if(next == count) {
+                count = log->read(batch.data(), batch.size());
+                next = 0;
+                if(count == 0) {
+                    if(reportName != NULL && log->failed()) report(vehicle);
+                    return;
+                }
+            }
+            const InputCommand &command = batch[next];
+            if(command.tick > tick) return;
+            if(command.menu == INPUT_ENVIRONMENT) vehicle.applyEnvironmentInput(command.code, command.value);
+            else vehicle.applyVehicleInput(command.code, command.value);
+            next++;
+        }
+    }
+
+};
+
+#endif
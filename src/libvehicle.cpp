@@ -0,0 +1,132 @@
+#include <vector>
+#include <new>
+
+#include "vehicle.cpp"
+#include "libvehicle.h"
+
+/* C ABI over Planning, see libvehicle.h */
+
+struct libvehicle_fleet {
+    std::vector<Planning> vehicles;
+    std::vector<libvehicle_input> queue;    // sized once, queued counts the used part
+    uint32_t queued;
+    uint64_t ticks;
+};
+
+static_assert(sizeof(libvehicle_status) == 80, "libvehicle_status layout is part of the ABI");
+
+static uint32_t statusFlags(const status_struct &status) {
+    uint32_t flags = 0;
+    if(status.cruise_control_active) flags |= LIBVEHICLE_CRUISE_CONTROL;
+    if(status.wipers_on) flags |= LIBVEHICLE_WIPERS;
+    if(status.cars_in_front) flags |= LIBVEHICLE_CARS_IN_FRONT;
+    if(status.cars_in_back) flags |= LIBVEHICLE_CARS_IN_BACK;
+    if(status.cars_on_left) flags |= LIBVEHICLE_CARS_ON_LEFT;
+    if(status.cars_on_right) flags |= LIBVEHICLE_CARS_ON_RIGHT;
+    if(status.rear_view) flags |= LIBVEHICLE_REAR_VIEW;
+    if(status.leftTurn) flags |= LIBVEHICLE_LEFT_TURN;
+    if(status.rightTurn) flags |= LIBVEHICLE_RIGHT_TURN;
+    return flags;
+}
+
+extern "C" {
+
+uint32_t libvehicle_abi_version(void) { return LIBVEHICLE_ABI_VERSION; }
+
+libvehicle_fleet *libvehicle_create(uint32_t count, uint32_t max_inputs) {
+    libvehicle_fleet *fleet = new (std::nothrow) libvehicle_fleet;
+    if(fleet == NULL) return NULL;
+    try {
+        fleet->vehicles.resize(count);
+        fleet->queue.resize(max_inputs);
+    } catch (...) {
+        delete fleet;
+        return NULL;
+    }
+    fleet->queued = 0;
+    fleet->ticks = 0;
+    return fleet;
+}
+
+void libvehicle_destroy(libvehicle_fleet *fleet) { delete fleet; }
+
+uint32_t libvehicle_count(const libvehicle_fleet *fleet) { return fleet->vehicles.size(); }
+
+uint64_t libvehicle_tick(const libvehicle_fleet *fleet) { return fleet->ticks; }
+
+uint32_t libvehicle_push_inputs(libvehicle_fleet *fleet, const libvehicle_input *inputs, uint32_t n) {
+    uint32_t accepted = 0;
+    while (accepted < n && fleet->queued < fleet->queue.size()) {
+        const libvehicle_input &input = inputs[accepted];
+        if(input.vehicle >= fleet->vehicles.size()) break;
+        if(input.menu != LIBVEHICLE_MENU_ENVIRONMENT && input.menu != LIBVEHICLE_MENU_VEHICLE) break;
+        fleet->queue[fleet->queued++] = input;
+        accepted++;
+    }
+    return accepted;
+}
+
+void libvehicle_step_many(libvehicle_fleet *fleet, uint32_t n_ticks) {
+    std::vector<Planning> &vehicles = fleet->vehicles;
+    size_t count = vehicles.size();
+    for (uint32_t t = 0; t < n_ticks; t++) {
+        for (size_t i = 0; i < count; i++) vehicles[i].tick();
+        for (uint32_t q = 0; q < fleet->queued; q++) {
+            const libvehicle_input &input = fleet->queue[q];
+            Planning &vehicle = vehicles[input.vehicle];
+            if(input.menu == LIBVEHICLE_MENU_ENVIRONMENT) vehicle.applyEnvironmentInput(input.option, input.value);
+            else vehicle.applyVehicleInput(input.option, input.value);
+        }
+        fleet->queued = 0;
+        for (size_t i = 0; i < count; i++) {
+            vehicles[i].updateDisplay();
+            vehicles[i].endTick();
+            tickArena.reset();
+        }
+        fleet->ticks++;
+    }
+}
+
+uint32_t libvehicle_read_status(const libvehicle_fleet *fleet, uint32_t first, uint32_t n, libvehicle_status *out) {
+    if(first >= fleet->vehicles.size()) return 0;
+    if(n > fleet->vehicles.size() - first) n = fleet->vehicles.size() - first;
+    for (uint32_t i = 0; i < n; i++) {
+        const telemetry_record &record = fleet->vehicles[first + i].getLastRecord();
+        libvehicle_status &status = out[i];
+        status.tick = record.tick;
+        status.state_hash = record.state_hash;
+        status.velocity = record.velocity;
+        status.distance_in_front = record.distance_in_front;
+        status.distance_behind = record.distance_behind;
+        status.light_level = record.light_level;
+        status.speed = record.status.speed;
+        status.gear = record.status.gear;
+        status.lane = record.status.lane;
+        status.num_lanes = record.status.num_lanes;
+        status.lane_warning = record.status.lane_warning;
+        status.headlights = record.status.headlights;
+        status.flags = statusFlags(record.status);
+        status.events = record.events;
+    }
+    return n;
+}
+
+int64_t libvehicle_time_to_collision(double speed, double gap, int32_t target) {
+    long ticks = trajectoryTables(*activeRules.enter()).predictTimeToCollision(speed, gap, target);
+    activeRules.leave();
+    return ticks;
+}
+
+int32_t libvehicle_ticks_to_stop(double speed, int32_t intensity) {
+    int ticks = trajectoryTables(*activeRules.enter()).ticksToStop(speed, intensity);
+    activeRules.leave();
+    return ticks;
+}
+
+double libvehicle_gap_after_stop(double speed, double gap, int32_t intensity) {
+    double after = trajectoryTables(*activeRules.enter()).gapAfterStop(speed, gap, intensity);
+    activeRules.leave();
+    return after;
+}
+
+}
@@ -0,0 +1,110 @@
+#ifndef LIBVEHICLE_H
+#define LIBVEHICLE_H
+
+#include <stdint.h>
+
+/* libvehicle: the planning logic without the terminal, for test harnesses and other hosts.
+
+   A fleet holds N vehicles. Inputs are queued with libvehicle_push_inputs and applied in the
+   next tick, libvehicle_step_many runs ticks for every vehicle, and libvehicle_read_status
+   copies packed status out. Memory is only allocated in libvehicle_create, and in the first
+   trajectory query on each thread after the rules change. A fleet is not thread-safe, use one
+   per thread.
+
+   Link with -lvehicle -lstdc++ -pthread -lrt when using the static library. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define LIBVEHICLE_API __attribute__((visibility("default")))
+#else
+#define LIBVEHICLE_API
+#endif
+
+#define LIBVEHICLE_ABI_VERSION 1
+
+/* menus, same option codes and values as the interactive ones */
+#define LIBVEHICLE_MENU_ENVIRONMENT 0    /* 0 default, 1 front, 2 behind, 3 side, 4 light, 5 rain */
+#define LIBVEHICLE_MENU_VEHICLE 1        /* 0 default, 1 brake to, 2 accelerate to, 3 gear, 4 signal */
+
+/* libvehicle_status.flags */
+#define LIBVEHICLE_CRUISE_CONTROL 0x001
+#define LIBVEHICLE_WIPERS 0x002
+#define LIBVEHICLE_CARS_IN_FRONT 0x004
+#define LIBVEHICLE_CARS_IN_BACK 0x008
+#define LIBVEHICLE_CARS_ON_LEFT 0x010
+#define LIBVEHICLE_CARS_ON_RIGHT 0x020
+#define LIBVEHICLE_REAR_VIEW 0x040
+#define LIBVEHICLE_LEFT_TURN 0x080
+#define LIBVEHICLE_RIGHT_TURN 0x100
+
+typedef struct libvehicle_fleet libvehicle_fleet;
+
+typedef struct libvehicle_input {
+    uint32_t vehicle;    /* index in the fleet */
+    int32_t menu;        /* LIBVEHICLE_MENU_* */
+    int32_t option;
+    int32_t value;
+} libvehicle_input;
+
+/* 80 bytes, layout is part of the ABI */
+typedef struct libvehicle_status {
+    uint64_t tick;           /* last completed tick */
+    uint64_t state_hash;
+    double velocity;
+    double distance_in_front;
+    double distance_behind;
+    double light_level;
+    int32_t speed;           /* mph as shown on the display */
+    int32_t gear;            /* 0 park, 1 reverse, 2 neutral, 3 drive */
+    int32_t lane;
+    int32_t num_lanes;
+    int32_t lane_warning;    /* -1 none, 0 left, 1 right */
+    int32_t headlights;      /* 0 off, 1 on, 2 high beams */
+    uint32_t flags;          /* LIBVEHICLE_* bits */
+    uint32_t events;         /* TelemetryEvent bits from telemetry.hpp, EVENT_* */
+} libvehicle_status;
+
+LIBVEHICLE_API uint32_t libvehicle_abi_version(void);
+
+/* count vehicles and room for max_inputs queued inputs, NULL if out of memory */
+LIBVEHICLE_API libvehicle_fleet *libvehicle_create(uint32_t count, uint32_t max_inputs);
+
+LIBVEHICLE_API void libvehicle_destroy(libvehicle_fleet *fleet);
+
+LIBVEHICLE_API uint32_t libvehicle_count(const libvehicle_fleet *fleet);
+
+/* ticks completed so far */
+LIBVEHICLE_API uint64_t libvehicle_tick(const libvehicle_fleet *fleet);
+
+/* queues inputs for the next tick in order, stops at the first invalid one or when the queue is
+   full, returns how many were queued */
+LIBVEHICLE_API uint32_t libvehicle_push_inputs(libvehicle_fleet *fleet, const libvehicle_input *inputs, uint32_t n);
+
+/* runs n_ticks ticks for every vehicle, the queued inputs go into the first of them */
+LIBVEHICLE_API void libvehicle_step_many(libvehicle_fleet *fleet, uint32_t n_ticks);
+
+/* copies the status of vehicles first .. first + n - 1 to out, returns how many were copied */
+LIBVEHICLE_API uint32_t libvehicle_read_status(const libvehicle_fleet *fleet, uint32_t first, uint32_t n,
+                                               libvehicle_status *out);
+
+/* Trajectory queries, answered from tables of what the planning logic does in drive.
+   Speeds are mph, gaps are the distance in front. */
+
+/* ticks until the gap closes while accelerating from speed to target, -1 if the target is
+   reached first */
+LIBVEHICLE_API int64_t libvehicle_time_to_collision(double speed, double gap, int32_t target);
+
+/* ticks of braking at intensity 1 .. 3 until stopped, -1 if it never stops */
+LIBVEHICLE_API int32_t libvehicle_ticks_to_stop(double speed, int32_t intensity);
+
+/* the gap once braking at intensity 1 .. 3 has stopped the vehicle, infinite if it never does */
+LIBVEHICLE_API double libvehicle_gap_after_stop(double speed, double gap, int32_t intensity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef NUMERIC_HPP
+#define NUMERIC_HPP
+
+#include <stdint.h>
+#include <limits.h>
+#include <cmath>
+#include <cstring>
+
+/* Q16.16 fixed point, saturates instead of wrapping so INT_MAX distances stay "far away" */
+
+class Q16_16 {
+
+    private:
+
+    int32_t raw;    // value * 65536
+
+    static int32_t saturate(int64_t value) {
+        if(value > INT32_MAX) return INT32_MAX;
+        if(value < INT32_MIN) return INT32_MIN;
+        return (int32_t)value;
+    }
+
+    public:
+
+    static const int FRACTION_BITS = 16;
+
+    Q16_16() { raw = 0; }
+
+    Q16_16(int value) { raw = saturate((int64_t)value * 65536); }
+
+    Q16_16(double value) {
+        double scaled = value * 65536.0;
+        if(scaled >= 2147483647.0) raw = INT32_MAX;
+        else if(scaled <= -2147483648.0) raw = INT32_MIN;
+        else raw = (int32_t)llround(scaled);
+    }
+
+    static Q16_16 fromRaw(int32_t bits) {
+        Q16_16 q;
+        q.raw = bits;
+        return q;
+    }
+
+    int32_t getRaw() const { return raw; }
+
+    explicit operator int() const { return raw / 65536; }    // truncates toward zero like (int) on a double
+
+    explicit operator double() const { return raw / 65536.0; }
+
+    Q16_16 operator-() const { return fromRaw(saturate(-(int64_t)raw)); }
+
+    friend Q16_16 operator+(Q16_16 a, Q16_16 b) { return fromRaw(saturate((int64_t)a.raw + b.raw)); }
+
+    friend Q16_16 operator-(Q16_16 a, Q16_16 b) { return fromRaw(saturate((int64_t)a.raw - b.raw)); }
+
+    friend Q16_16 operator*(Q16_16 a, Q16_16 b) { return fromRaw(saturate(((int64_t)a.raw * b.raw) >> FRACTION_BITS)); }
+
+    friend Q16_16 operator/(Q16_16 a, Q16_16 b) {
+        if(b.raw == 0) return fromRaw(a.raw < 0 ? INT32_MIN : INT32_MAX);
+        return fromRaw(saturate(((int64_t)a.raw * 65536) / b.raw));
+    }
+
+    friend bool operator==(Q16_16 a, Q16_16 b) { return a.raw == b.raw; }
+
+    friend bool operator!=(Q16_16 a, Q16_16 b) { return a.raw != b.raw; }
+
+    friend bool operator<(Q16_16 a, Q16_16 b) { return a.raw < b.raw; }
+
+    friend bool operator<=(Q16_16 a, Q16_16 b) { return a.raw <= b.raw; }
+
+    friend bool operator>(Q16_16 a, Q16_16 b) { return a.raw > b.raw; }
+
+    friend bool operator>=(Q16_16 a, Q16_16 b) { return a.raw >= b.raw; }
+
+};
+
+
+/* numeric type for vehicle dynamics, picked at compile time (see NUMERIC in the makefile) */
+
+#if defined(VEHICLE_FIXED_POINT)
+typedef Q16_16 Numeric;
+#elif defined(VEHICLE_SINGLE_PRECISION)
+typedef float Numeric;
+#else
+typedef double Numeric;
+#endif
+
+
+/* bit pattern of a value, for hashing and byte-for-byte replay comparisons */
+
+inline uint64_t numericBits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline uint64_t numericBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline uint64_t numericBits(Q16_16 value) { return (uint32_t)value.getRaw(); }
+
+#endif
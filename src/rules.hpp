@@ -0,0 +1,425 @@
+#ifndef RULES_HPP
+#define RULES_HPP
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+/* Control thresholds
+
+   A RuleConfig is never modified once published. Vehicles pin the current one for the length
+   of a tick, a RuleWatcher swaps in a new one whenever the rules file changes, and the old
+   one is freed once every thread that could still be reading it has finished its tick.
+
+   rules file, one "key = value" per line, '#' starts a comment, missing keys keep their defaults:
+
+       brake_gap_far = 100          # automatic braking below this distance in front
+       brake_gap_near = 20          # harder braking at or below this
+       brake_gap_close = 10         # hardest braking at or below this
+       reverse_gap = 20             # braking in reverse below this distance behind
+       headlight_light_level = 200  # headlights below this light level
+       high_beam_light_level = 50   # high beams below this light level
+       high_beam_speed = 25         # and above this speed
+       gear_change_speed = 5        # gear changes only within +- this speed
+       brake_factor_light = 0.95    # velocity kept per tick at each braking intensity
+       brake_factor_medium = 0.90
+       brake_factor_hard = 0.85 */
+
+struct RuleConfig {
+    int brakeGapFar = 100;
+    int brakeGapNear = 20;
+    int brakeGapClose = 10;
+    int reverseGap = 20;
+    int headlightLightLevel = 200;
+    int highBeamLightLevel = 50;
+    int highBeamSpeed = 25;
+    int gearChangeSpeed = 5;
+    double brakeFactor[3] = {.95, .90, .85};    // by intensity 1, 2, 3
+    uint32_t generation = 0;                     // set when published
+};
+
+/* fills config from the file's text, on failure error says which line is wrong */
+inline bool parseRuleConfig(const std::string &text, RuleConfig &config, std::string &error) {
+    struct IntKey { const char *name; int RuleConfig::*field; };
+    static const IntKey intKeys[] = {
+        {"brake_gap_far", &RuleConfig::brakeGapFar},
+        {"brake_gap_near", &RuleConfig::brakeGapNear},
+        {"brake_gap_close", &RuleConfig::brakeGapClose},
+        {"reverse_gap", &RuleConfig::reverseGap},
+        {"headlight_light_level", &RuleConfig::headlightLightLevel},
+        {"high_beam_light_level", &RuleConfig::highBeamLightLevel},
+        {"high_beam_speed", &RuleConfig::highBeamSpeed},
+        {"gear_change_speed", &RuleConfig::gearChangeSpeed}
+    };
+    static const char *factorKeys[3] = {"brake_factor_light", "brake_factor_medium", "brake_factor_hard"};
+
+    RuleConfig parsed;
+    size_t start = 0;
+    for (int line = 1; start < text.size(); line++) {
+        size_t end = text.find('\n', start);
+        if(end == std::string::npos) end = text.size();
+        std::string content = text.substr(start, end - start);
+        start = end + 1;
+
+        size_t comment = content.find('#');
+        if(comment != std::string::npos) content.erase(comment);
+        char key[64], value[64], rest[2];
+        int fields = sscanf(content.c_str(), " %63[a-z_] = %63s %1s", key, value, rest);
+        if(fields <= 0) continue;    // blank or comment only
+        std::string where = "line " + std::to_string(line) + ": ";
+        if(fields != 2) {
+            error = where + "expected key = value";
+            return false;
+        }
+
+        char *tail;
+        bool known = false;
+        for (size_t i = 0; i < sizeof(intKeys) / sizeof(intKeys[0]) && !known; i++) {
+            if(strcmp(key, intKeys[i].name) != 0) continue;
+            long number = strtol(value, &tail, 10);
+            if(*tail != '\0' || number < 0 || number > INT32_MAX) {
+                error = where + key + " must be a non-negative integer";
+                return false;
+            }
+            parsed.*intKeys[i].field = (int)number;
+            known = true;
+        }
+        for (int i = 0; i < 3 && !known; i++) {
+            if(strcmp(key, factorKeys[i]) != 0) continue;
+            double factor = strtod(value, &tail);
+            if(*tail != '\0' || !(factor > 0 && factor <= 1)) {
+                error = where + key + " must be in (0, 1]";
+                return false;
+            }
+            parsed.brakeFactor[i] = factor;
+            known = true;
+        }
+        if(!known) {
+            error = where + "unknown key " + key;
+            return false;
+        }
+    }
+
+    if(!(parsed.brakeGapFar > parsed.brakeGapNear && parsed.brakeGapNear > parsed.brakeGapClose)) {
+        error = "brake gaps must satisfy far > near > close";
+        return false;
+    }
+    config = parsed;
+    return true;
+}
+
+
+/* RCU-style holder: readers never lock, publishers retire the old config with the epoch it was
+   replaced in and free it once no reader slot is still in an older epoch. A thread claims a
+   slot on its first enter() and hands it back when it exits. */
+
+class RuleSet {
+
+    private:
+
+    static const int MAX_READERS = 64;    // threads reading rules at once, one bit each in slotsInUse
+    static const int MAX_SETS = 4;        // rule sets a thread reads from
+
+    struct Retired {
+        const RuleConfig *config;
+        uint64_t epoch;
+    };
+
+    struct Reader {
+        uint64_t owner;     // id of the RuleSet, 0 for an unused entry
+        int slot;
+        int depth;          // enter() without leave(), a fleet pins once for all its vehicles
+        const RuleConfig *pinned;
+    };
+
+    /* a thread's readers, their slots go back to the sets still alive when it exits */
+    struct LocalReaders {
+        Reader entries[MAX_SETS];
+        ~LocalReaders() {
+            for (int i = 0; i < MAX_SETS; i++) releaseSlot(entries[i]);
+        }
+    };
+
+    /* live sets, found by id when a thread gives back its slots */
+    struct Registry {
+        std::mutex lock;
+        std::vector<RuleSet *> sets;
+    };
+
+    std::atomic<const RuleConfig *> current;
+    std::atomic<uint64_t> epoch;                    // starts at 1, a slot of 0 is not reading
+    std::atomic<uint64_t> readers[MAX_READERS];
+    std::atomic<uint64_t> slotsInUse;
+    std::mutex publishers;                         // never taken by readers
+    std::vector<Retired> retired;
+    uint32_t generations;
+    uint64_t id;            // never reused, so a set at the address of a destroyed one starts fresh
+
+    static_assert(MAX_READERS == 64, "slotsInUse has a bit per reader slot");
+
+    /* never destroyed, threads can still exit after static destructors ran */
+    static Registry &registry() {
+        static Registry *sets = new Registry();
+        return *sets;
+    }
+
+    /* lowest free slot, only a thread's first enter() on this set gets here */
+    int claimSlot() {
+        uint64_t used = slotsInUse.load();
+        while (true) {
+            if(~used == 0) {
+                fprintf(stderr, "more than %d threads read the rules at once\n", MAX_READERS);
+                abort();
+            }
+            int slot = __builtin_ctzll(~used);
+            if(slotsInUse.compare_exchange_weak(used, used | 1ULL << slot)) return slot;
+        }
+    }
+
+    /* hands a reader's slot back to its set if the set is still alive, and clears the entry */
+    static void releaseSlot(Reader &reader) {
+        if(reader.owner != 0 && reader.slot >= 0) {
+            Registry &live = registry();
+            std::lock_guard<std::mutex> lock(live.lock);
+            for (size_t i = 0; i < live.sets.size(); i++) {
+                RuleSet *set = live.sets[i];
+                if(set->id != reader.owner) continue;
+                set->readers[reader.slot].store(0);
+                set->slotsInUse.fetch_and(~(1ULL << reader.slot));
+                break;
+            }
+        }
+        reader = Reader{0, -1, 0, NULL};
+    }
+
+    /* this thread's reader state for this set, ids instead of addresses key it */
+    Reader &localReader() {
+        static thread_local LocalReaders perThread;
+        Reader *local = perThread.entries;
+        if(local[0].owner == id) return local[0];
+        Reader *unused = NULL;
+        for (int i = 0; i < MAX_SETS; i++) {
+            if(local[i].owner == id) return local[i];
+            if(unused == NULL && local[i].depth == 0) unused = &local[i];
+        }
+        if(unused == NULL) {
+            fprintf(stderr, "a thread holds more than %d rule sets at once\n", MAX_SETS);
+            abort();
+        }
+        // an entry not pinning anything can be taken over once its set has its slot back
+        releaseSlot(*unused);
+        unused->owner = id;
+        return *unused;
+    }
+
+    size_t reclaimLocked() {
+        uint64_t oldest = UINT64_MAX;
+        for (int i = 0; i < MAX_READERS; i++) {
+            uint64_t e = readers[i].load();
+            if(e != 0 && e < oldest) oldest = e;
+        }
+        size_t kept = 0, freed = 0;
+        for (size_t i = 0; i < retired.size(); i++) {
+            if(retired[i].epoch <= oldest) {
+                delete retired[i].config;
+                freed++;
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+        return freed;
+    }
+
+    public:
+
+    RuleSet() {
+        current.store(new RuleConfig());
+        epoch.store(1);
+        for (int i = 0; i < MAX_READERS; i++) readers[i].store(0);
+        slotsInUse.store(0);
+        generations = 0;
+        static std::atomic<uint64_t> nextId(1);
+        id = nextId.fetch_add(1);
+        Registry &live = registry();
+        std::lock_guard<std::mutex> lock(live.lock);
+        live.sets.push_back(this);
+    }
+
+    ~RuleSet() {
+        {
+            Registry &live = registry();
+            std::lock_guard<std::mutex> lock(live.lock);
+            for (size_t i = 0; i < live.sets.size(); i++) {
+                if(live.sets[i] == this) {
+                    live.sets.erase(live.sets.begin() + i);
+                    break;
+                }
+            }
+        }
+        delete current.load();
+        for (size_t i = 0; i < retired.size(); i++) delete retired[i].config;
+    }
+
+    /* pins the current config for this thread until the matching leave() */
+    const RuleConfig *enter() {
+        Reader &reader = localReader();
+        if(reader.depth++ > 0) return reader.pinned;
+        if(reader.slot < 0) reader.slot = claimSlot();
+        readers[reader.slot].store(epoch.load());
+        reader.pinned = current.load();
+        return reader.pinned;
+    }
+
+    void leave() {
+        Reader &reader = localReader();
+        if(--reader.depth == 0) readers[reader.slot].store(0);
+    }
+
+    /* takes ownership, readers see it from their next enter() */
+    void publish(RuleConfig *config) {
+        std::lock_guard<std::mutex> lock(publishers);
+        config->generation = ++generations;
+        const RuleConfig *old = current.exchange(config);
+        Retired r = {old, epoch.fetch_add(1) + 1};
+        retired.push_back(r);
+        reclaimLocked();
+    }
+
+    /* frees retired configs no reader can still hold, returns how many */
+    size_t reclaim() {
+        std::lock_guard<std::mutex> lock(publishers);
+        return reclaimLocked();
+    }
+
+    size_t retiredCount() {
+        std::lock_guard<std::mutex> lock(publishers);
+        return retired.size();
+    }
+
+};
+
+
+/* reloads a rules file whenever it is written or replaced, bad files keep the previous rules */
+
+class RuleWatcher {
+
+    private:
+
+    RuleSet *rules;
+    std::string path;
+    std::string directory;
+    std::string name;
+    int inotifyFd;
+    int wakeFd;
+    std::thread thread;
+    std::atomic<unsigned> reloads;
+    std::atomic<bool> stopping;     // also seen on the next poll timeout if the wakeup cannot be written
+
+    bool load(std::string &error) {
+        FILE *file = fopen(path.c_str(), "r");
+        if(file == NULL) {
+            error = "cannot read the file";
+            return false;
+        }
+        std::string text;
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, n);
+        fclose(file);
+
+        RuleConfig config;
+        if(!parseRuleConfig(text, config, error)) return false;
+        rules->publish(new RuleConfig(config));
+        reloads++;
+        return true;
+    }
+
+    void watch() {
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while (true) {
+            struct pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+            int ready = poll(fds, 2, 1000);
+            if(stopping.load() || (ready > 0 && (fds[1].revents & POLLIN))) return;
+            if(ready < 0) continue;
+            if(ready == 0) {
+                rules->reclaim();    // readers may have moved on since the last swap
+                continue;
+            }
+            ssize_t length = read(inotifyFd, events, sizeof(events));
+            bool changed = false;
+            for (ssize_t offset = 0; offset < length;) {
+                const struct inotify_event *event = (const struct inotify_event *)(events + offset);
+                if(event->len > 0 && name == event->name) changed = true;
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+            std::string error;
+            if(changed && !load(error)) fprintf(stderr, "%s: %s, keeping the previous rules\n", path.c_str(), error.c_str());
+        }
+    }
+
+    public:
+
+    RuleWatcher() {
+        rules = NULL;
+        inotifyFd = -1;
+        wakeFd = -1;
+        reloads.store(0);
+        stopping.store(false);
+    }
+
+    ~RuleWatcher() { stop(); }
+
+    /* loads the file once, then keeps watching it; error is set if the first load fails */
+    bool start(RuleSet &target, const char *file, std::string &error) {
+        rules = &target;
+        path = file;
+        size_t slash = path.rfind('/');
+        directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+        name = slash == std::string::npos ? path : path.substr(slash + 1);
+        if(!load(error)) return false;
+
+        // the directory is watched because editors save by renaming a new file over the old one
+        inotifyFd = inotify_init1(IN_CLOEXEC);
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if(inotifyFd < 0 || wakeFd < 0
+           || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            error = "cannot watch " + directory;
+            stop();
+            return false;
+        }
+        stopping.store(false);
+        thread = std::thread(&RuleWatcher::watch, this);
+        return true;
+    }
+
+    /* joins the watcher on every path, at worst it notices stopping at its next poll timeout */
+    void stop() {
+        if(thread.joinable()) {
+            stopping.store(true);
+            uint64_t one = 1;
+            ssize_t written = write(wakeFd, &one, sizeof(one));
+            (void)written;
+            thread.join();
+        }
+        if(inotifyFd >= 0) close(inotifyFd);
+        if(wakeFd >= 0) close(wakeFd);
+        inotifyFd = -1;
+        wakeFd = -1;
+    }
+
+    unsigned getReloadCount() const { return reloads.load(); }
+
+};
+
+#endif
@@ -0,0 +1,481 @@
+#ifndef SCENARIO_HPP
+#define SCENARIO_HPP
+
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+#include <cmath>
+
+#include "vehicle.cpp"
+
+/* Scenario scripts
+
+   One statement per line or separated by ';', '#' starts a comment:
+
+       at t=3s set front distance 15
+       when speed<30 accelerate to 70
+       repeat 100 times: toggle rain every 2s
+       every 10s: signal left
+       when ttc<3 brake to 20
+
+   Times are simulated seconds ("2s") or ticks ("4t", "4 ticks", or a bare number). Each statement
+   compiles to its own thread of bytecode. A program is compiled once and shared; a running
+   script only holds a pc, wake tick and loop counter per thread, so thousands fit in a process. */
+
+enum ScenarioOp {
+    OP_HALT,
+    OP_WAIT_UNTIL,        // sleep until tick >= value
+    OP_WAIT_TICKS,        // sleep for value ticks
+    OP_WAIT_COND,         // yield until the condition holds
+    OP_WAIT_NOT_COND,     // yield until the condition stops holding
+    OP_SET_COUNTER,
+    OP_LOOP,              // decrement the counter, jump to value while it is above zero
+    OP_JUMP,
+    OP_ENV,               // environment menu input arg with value
+    OP_VEHICLE,           // vehicle menu input arg with value
+    OP_TOGGLE_RAIN
+};
+
+enum ScenarioVar { VAR_SPEED, VAR_FRONT, VAR_BEHIND, VAR_LIGHT, VAR_GEAR, VAR_LANE, VAR_RAIN, VAR_TICK, VAR_TTC };
+
+enum ScenarioCmp { CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_EQ, CMP_NE };
+
+struct ScenarioInstruction {
+    uint8_t op;
+    uint8_t arg;       // condition variable, or menu code for OP_ENV / OP_VEHICLE
+    uint8_t cmp;
+    uint8_t unused;
+    int32_t value;     // threshold, ticks, menu value or jump target
+};
+
+
+class ScenarioProgram {
+
+    private:
+
+    struct Token {
+        std::string text;
+        int line;
+        int column;
+    };
+
+    std::vector<ScenarioInstruction> code;
+    std::vector<uint16_t> entries;      // first instruction of every statement
+    std::string error;
+    double ticksPerSecond;
+
+    std::vector<Token> tokens;          // the statement being compiled
+    size_t next;
+
+    bool fail(const Token &at, const std::string &message) {
+        error = std::to_string(at.line) + ":" + std::to_string(at.column) + ": " + message;
+        return false;
+    }
+
+    bool failAtEnd(const std::string &message) {
+        if(tokens.empty()) {
+            error = message;
+            return false;
+        }
+        const Token &last = tokens.back();
+        Token end = {"", last.line, last.column + (int)last.text.size()};
+        return fail(end, message);
+    }
+
+    bool atEnd() const { return next >= tokens.size(); }
+
+    bool peek(const char *word) const { return !atEnd() && tokens[next].text == word; }
+
+    bool accept(const char *word) {
+        if(!peek(word)) return false;
+        next++;
+        return true;
+    }
+
+    bool expect(const char *word) {
+        if(accept(word)) return true;
+        if(atEnd()) return failAtEnd(std::string("expected '") + word + "'");
+        return fail(tokens[next], std::string("expected '") + word + "', found '" + tokens[next].text + "'");
+    }
+
+    bool number(int &out) {
+        if(atEnd()) return failAtEnd("expected a number");
+        const Token &t = tokens[next];
+        char *end;
+        long value = strtol(t.text.c_str(), &end, 10);
+        if(end == t.text.c_str() || *end != '\0') return fail(t, "expected a number, found '" + t.text + "'");
+        out = (int)value;
+        next++;
+        return true;
+    }
+
+    /* "3s" in simulated seconds, "4t", "4 ticks" or "4" in ticks */
+    bool duration(int &ticks) {
+        if(atEnd()) return failAtEnd("expected a time");
+        const Token &t = tokens[next];
+        char *end;
+        double value = strtod(t.text.c_str(), &end);
+        if(end == t.text.c_str() || value < 0) return fail(t, "expected a time, found '" + t.text + "'");
+        std::string unit(end);
+        next++;
+        if(unit.empty() && (accept("ticks") || accept("tick") || accept("t"))) unit = "t";
+        else if(unit.empty() && (accept("seconds") || accept("s"))) unit = "s";
+        if(unit == "s") ticks = (int)llround(value * ticksPerSecond);
+        else if(unit.empty() || unit == "t") ticks = (int)llround(value);
+        else return fail(t, "unknown time unit '" + unit + "'");
+        return true;
+    }
+
+    bool condition(ScenarioInstruction &in) {
+        static const char *vars[] = {"speed", "front", "behind", "light", "gear", "lane", "rain", "tick", "ttc"};
+        static const char *cmps[] = {"<", "<=", ">", ">=", "==", "!="};
+        if(atEnd()) return failAtEnd("expected a condition");
+        const Token &var = tokens[next];
+        int v = 0;
+        while (v < 9 && var.text != vars[v]) v++;
+        if(v == 9) return fail(var, "unknown variable '" + var.text + "'");
+        next++;
+        if(atEnd()) return failAtEnd("expected a comparison");
+        const Token &cmp = tokens[next];
+        int c = 0;
+        while (c < 6 && cmp.text != cmps[c]) c++;
+        if(c == 6) return fail(cmp, "expected a comparison, found '" + cmp.text + "'");
+        next++;
+        int value;
+        if(v == VAR_RAIN && (peek("on") || peek("off"))) value = tokens[next++].text == "on";
+        else if(!number(value)) return false;
+        in.arg = v;
+        in.cmp = c;
+        in.value = value;
+        return true;
+    }
+
+    void emit(uint8_t op, uint8_t arg, int32_t value) {
+        ScenarioInstruction in = {op, arg, 0, 0, value};
+        code.push_back(in);
+    }
+
+    /* a menu input, same codes as run_systems() */
+    bool action() {
+        if(atEnd()) return failAtEnd("expected an action");
+        const Token &verb = tokens[next++];
+        int value;
+        if(verb.text == "set") {
+            if(accept("front")) {
+                accept("distance");
+                if(!number(value)) return false;
+                emit(OP_ENV, 1, value);
+            } else if(accept("behind")) {
+                accept("distance");
+                if(!number(value)) return false;
+                emit(OP_ENV, 2, value);
+            } else if(accept("light")) {
+                accept("level");
+                if(!number(value)) return false;
+                emit(OP_ENV, 4, value);
+            } else if(accept("object")) {
+                if(accept("left")) emit(OP_ENV, 3, -1);
+                else if(accept("right")) emit(OP_ENV, 3, 1);
+                else if(accept("none")) emit(OP_ENV, 3, 0);
+                else return atEnd() ? failAtEnd("expected left, right or none") : fail(tokens[next], "expected left, right or none");
+            } else if(accept("rain")) {
+                if(accept("on")) emit(OP_ENV, 5, 1);
+                else if(accept("off")) emit(OP_ENV, 5, 0);
+                else return atEnd() ? failAtEnd("expected on or off") : fail(tokens[next], "expected on or off");
+            } else {
+                return atEnd() ? failAtEnd("expected front, behind, light, object or rain")
+                               : fail(tokens[next], "cannot set '" + tokens[next].text + "'");
+            }
+        } else if(verb.text == "rain") {
+            if(accept("on")) emit(OP_ENV, 5, 1);
+            else if(accept("off")) emit(OP_ENV, 5, 0);
+            else return atEnd() ? failAtEnd("expected on or off") : fail(tokens[next], "expected on or off");
+        } else if(verb.text == "toggle") {
+            if(!expect("rain")) return false;
+            emit(OP_TOGGLE_RAIN, 0, 0);
+        } else if(verb.text == "reset") {
+            if(accept("environment")) emit(OP_ENV, 0, 0);
+            else if(accept("vehicle")) emit(OP_VEHICLE, 0, 0);
+            else return atEnd() ? failAtEnd("expected environment or vehicle") : fail(tokens[next], "expected environment or vehicle");
+        } else if(verb.text == "accelerate" || verb.text == "brake") {
+            accept("to");
+            if(!number(value)) return false;
+            emit(OP_VEHICLE, verb.text == "brake" ? 1 : 2, value);
+        } else if(verb.text == "gear") {
+            accept("to");
+            if(accept("park")) value = 0;
+            else if(accept("reverse")) value = 1;
+            else if(accept("drive")) value = 3;
+            else if(!number(value)) return false;
+            emit(OP_VEHICLE, 3, value);
+        } else if(verb.text == "signal") {
+            if(accept("left")) emit(OP_VEHICLE, 4, -1);
+            else if(accept("right")) emit(OP_VEHICLE, 4, 1);
+            else return atEnd() ? failAtEnd("expected left or right") : fail(tokens[next], "expected left or right");
+        } else {
+            return fail(verb, "unknown action '" + verb.text + "'");
+        }
+        return true;
+    }
+
+    bool statement() {
+        next = 0;
+        entries.push_back(code.size());
+        const Token &first = tokens[next++];
+
+        if(first.text == "at") {
+            if(accept("t") && !expect("=")) return false;
+            int when;
+            if(!duration(when)) return false;
+            accept(":");
+            emit(OP_WAIT_UNTIL, 0, when);
+            if(!action()) return false;
+        } else if(first.text == "when") {
+            ScenarioInstruction wait;
+            if(!condition(wait)) return false;
+            accept(":");
+            int top = code.size();
+            wait.op = OP_WAIT_COND;
+            code.push_back(wait);
+            if(!action()) return false;
+            wait.op = OP_WAIT_NOT_COND;    // fire again only after the condition went away
+            code.push_back(wait);
+            emit(OP_JUMP, 0, top);
+        } else if(first.text == "every" || first.text == "repeat") {
+            // every T [repeat N [times]]: action   or   repeat N [times]: action every T
+            int period = 0, count = 0;
+            bool counted = first.text == "repeat";
+            if(counted) {
+                if(!number(count)) return false;
+                accept("times");
+            } else {
+                if(!duration(period)) return false;
+                if(accept("repeat")) {
+                    counted = true;
+                    if(!number(count)) return false;
+                    accept("times");
+                }
+            }
+            accept(":");
+            if(counted && count <= 0) return fail(first, "repeat count must be positive");
+
+            if(counted) emit(OP_SET_COUNTER, 0, count);
+            int top = code.size();
+            emit(OP_WAIT_TICKS, 0, 0);
+            if(!action()) return false;
+            if(first.text == "repeat") {
+                if(!expect("every") || !duration(period)) return false;
+            }
+            code[top].value = period > 0 ? period : 1;
+            if(counted) emit(OP_LOOP, 0, top);
+            else emit(OP_JUMP, 0, top);
+        } else {
+            return fail(first, "expected at, when, every or repeat, found '" + first.text + "'");
+        }
+
+        if(!atEnd()) return fail(tokens[next], "unexpected '" + tokens[next].text + "'");
+        emit(OP_HALT, 0, 0);
+        return true;
+    }
+
+    public:
+
+    ScenarioProgram() { ticksPerSecond = 1; next = 0; }
+
+    bool compile(const std::string &source, double rate) {
+        code.clear();
+        entries.clear();
+        error.clear();
+        ticksPerSecond = rate;
+
+        tokens.clear();
+        int line = 1, column = 1;
+        size_t i = 0;
+        while (i <= source.size()) {
+            char c = i < source.size() ? source[i] : '\n';
+            if(c == '\n' || c == ';') {
+                if(!tokens.empty() && !statement()) return false;
+                tokens.clear();
+                if(c == '\n') {
+                    line++;
+                    column = 1;
+                } else {
+                    column++;
+                }
+                i++;
+                continue;
+            }
+            if(c == '#') {
+                while (i < source.size() && source[i] != '\n') i++;
+                continue;
+            }
+            if(isspace((unsigned char)c)) {
+                i++;
+                column++;
+                continue;
+            }
+            size_t start = i;
+            if(isalnum((unsigned char)c) || c == '_' || c == '.'
+               || (c == '-' && i + 1 < source.size() && isdigit((unsigned char)source[i + 1]))) {
+                i++;
+                while (i < source.size() && (isalnum((unsigned char)source[i]) || source[i] == '_' || source[i] == '.')) i++;
+            } else if((c == '<' || c == '>' || c == '=' || c == '!') && i + 1 < source.size() && source[i + 1] == '=') {
+                i += 2;
+            } else {
+                i++;
+            }
+            Token t = {source.substr(start, i - start), line, column};
+            tokens.push_back(t);
+            column += i - start;
+        }
+        if(code.size() > 65535) {
+            error = "scenario too large";
+            return false;
+        }
+        return true;
+    }
+
+    const std::string &getError() const { return error; }
+
+    const ScenarioInstruction *instructions() const { return code.data(); }
+
+    size_t size() const { return code.size(); }
+
+    size_t threadCount() const { return entries.size(); }
+
+    uint16_t entry(size_t thread) const { return entries[thread]; }
+
+};
+
+
+/* in.arg compared against in.value with in.cmp, shared with the driver agents */
+inline bool conditionHolds(Planning &vehicle, const ScenarioInstruction &in, uint64_t tick) {
+    double value;
+    switch(in.arg) {
+        case VAR_SPEED: value = vehicle.getSpeed(); break;
+        case VAR_FRONT: value = vehicle.getDistanceInFront(); break;
+        case VAR_BEHIND: value = vehicle.getDistanceBehind(); break;
+        case VAR_LIGHT: value = vehicle.getLightLevel(); break;
+        case VAR_GEAR: value = vehicle.getGear(); break;
+        case VAR_LANE: value = vehicle.getLane(); break;
+        case VAR_RAIN: value = vehicle.isRaining(); break;
+        case VAR_TTC: {
+            long ticks = vehicle.predictTimeToCollision();
+            value = ticks < 0 ? INFINITY : ticks;
+            break;
+        }
+        default: value = (double)tick; break;
+    }
+    switch(in.cmp) {
+        case CMP_LT: return value < in.value;
+        case CMP_LE: return value <= in.value;
+        case CMP_GT: return value > in.value;
+        case CMP_GE: return value >= in.value;
+        case CMP_EQ: return value == in.value;
+        default: return value != in.value;
+    }
+}
+
+
+/* one running copy of a program against one vehicle */
+
+class ScenarioInstance : public TickInputs {
+
+    private:
+
+    static const uint16_t HALTED = 0xffff;
+    static const int BUDGET = 64;          // instructions a thread may run per tick
+
+    struct Thread {
+        uint64_t wake;     // first tick the thread wants to run again, as wide as the tick count
+        uint16_t pc;
+        int32_t counter;
+    };
+
+    const ScenarioProgram *program;
+    std::vector<Thread> threads;
+    int running;
+
+    public:
+
+    ScenarioInstance(const ScenarioProgram &compiled) {
+        program = &compiled;
+        threads.resize(compiled.threadCount());
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].pc = compiled.entry(i);
+            threads[i].wake = 0;
+            threads[i].counter = 0;
+        }
+        running = threads.size();
+    }
+
+    bool finished() const { return running == 0; }
+
+    void apply(Planning &vehicle) override {
+        const ScenarioInstruction *code = program->instructions();
+        uint64_t tick = vehicle.getTickCount();
+        for (size_t i = 0; i < threads.size(); i++) {
+            Thread &t = threads[i];
+            if(t.pc == HALTED || t.wake > tick) continue;
+            bool yield = false;
+            for (int budget = BUDGET; budget > 0 && !yield; budget--) {
+                const ScenarioInstruction &in = code[t.pc];
+                switch(in.op) {
+                    case OP_HALT:
+                        t.pc = HALTED;
+                        running--;
+                        yield = true;
+                        break;
+                    case OP_WAIT_UNTIL:
+                        if(tick < (uint64_t)in.value) {
+                            t.wake = (uint64_t)in.value;
+                            yield = true;
+                        } else {
+                            t.pc++;
+                        }
+                        break;
+                    case OP_WAIT_TICKS:
+                        t.wake = tick + (uint64_t)in.value;
+                        t.pc++;
+                        yield = true;
+                        break;
+                    case OP_WAIT_COND:
+                        if(conditionHolds(vehicle, in, tick)) t.pc++;
+                        else yield = true;
+                        break;
+                    case OP_WAIT_NOT_COND:
+                        if(!conditionHolds(vehicle, in, tick)) t.pc++;
+                        else yield = true;
+                        break;
+                    case OP_SET_COUNTER:
+                        t.counter = in.value;
+                        t.pc++;
+                        break;
+                    case OP_LOOP:
+                        if(--t.counter > 0) t.pc = in.value;
+                        else t.pc++;
+                        break;
+                    case OP_JUMP:
+                        t.pc = in.value;
+                        break;
+                    case OP_ENV:
+                        vehicle.applyEnvironmentInput(in.arg, in.value);
+                        t.pc++;
+                        break;
+                    case OP_VEHICLE:
+                        vehicle.applyVehicleInput(in.arg, in.value);
+                        t.pc++;
+                        break;
+                    case OP_TOGGLE_RAIN:
+                        vehicle.applyEnvironmentInput(5, vehicle.isRaining() ? 0 : 1);
+                        t.pc++;
+                        break;
+                }
+            }
+        }
+    }
+
+};
+
+#endif
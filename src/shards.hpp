@@ -0,0 +1,420 @@
+#ifndef SHARDS_HPP
+#define SHARDS_HPP
+
+#include <stdint.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "vehicle.cpp"
+
+/* Sharded road
+
+   A ring road split into equal segments, each owned by a worker process. Every tick each
+   vehicle senses the nearest vehicle ahead and behind in its lane and anything alongside in the
+   next lanes, runs its control tick and moves on by its speed. The workers share one mapping
+   made before fork and go through two barriers a tick:
+
+       hand vehicles that crossed a border to the neighbour, whole (VehicleState)
+       -- barrier --
+       adopt the vehicles handed over, publish the ones within sensor range of a border (halo)
+       -- barrier --
+       sense with the neighbours' halos, tick, move
+
+   Sensing only uses where vehicles were at the start of the tick, so a run gives the same fleet
+   hash for any number of shards. */
+
+static const int ROAD_LANES = 4;
+static const double SENSOR_RANGE = 300;    // feet, also how deep the halo reaches into a neighbour
+static const double SIDE_RANGE = 15;       // a vehicle this close in the next lane is alongside
+static const double FEET_PER_MPH_TICK = 5280.0 / 3600 / Planning::TICKS_PER_SECOND;
+
+static_assert(std::is_trivially_copyable<VehicleState>::value, "vehicles are copied between processes as bytes");
+
+struct RoadGhost {
+    uint32_t id;
+    int32_t lane;
+    double position;
+};
+
+struct RoadMigrant {
+    uint32_t id;
+    double position;
+    VehicleState state;
+};
+
+struct ShardResult {
+    uint64_t fleetHash;     // each vehicle's tick chain folded together
+    uint64_t migrations;    // vehicles handed on
+    uint64_t hardBrakes;
+    uint64_t ghosts;        // halo entries read
+    uint32_t vehicles;
+    double speed;           // summed over the vehicles
+};
+
+/* a worker's outboxes, direction 0 goes to the segment behind and 1 to the one ahead */
+struct ShardMailbox {
+    uint32_t ghostCount[2];
+    uint32_t migrantCount[2];
+    ShardResult result;
+};
+
+
+class ShardedRoad {
+
+    private:
+
+    struct RoadVehicle {
+        uint32_t id;
+        double position;
+        std::unique_ptr<Planning> vehicle;
+    };
+
+    /* a vehicle as the sensors see it */
+    struct Sighting {
+        int32_t lane;
+        double position;
+        uint32_t id;
+        int32_t own;        // index in vehicles, -1 for a halo entry
+
+        bool operator<(const Sighting &other) const {
+            if(lane != other.lane) return lane < other.lane;
+            if(position != other.position) return position < other.position;
+            return id < other.id;
+        }
+    };
+
+    int shards;
+    uint32_t count;
+    double length;
+    double segment;
+
+    char *memory;
+    size_t mappedBytes;
+    size_t mailboxBytes;
+    size_t ghostsOffset;
+    size_t migrantsOffset;
+    pthread_barrier_t *barrier;
+
+    // the worker's own part, only used after fork
+    int shard;
+    std::vector<RoadVehicle> vehicles;
+    std::vector<std::unique_ptr<Planning> > spare;    // left behind by migrants, reused for arrivals
+    std::vector<Sighting> sightings;
+    size_t laneStart[ROAD_LANES + 2];
+    ShardResult result;
+
+    static size_t align(size_t bytes) { return (bytes + 63) & ~(size_t)63; }
+
+    ShardMailbox &mailbox(int s) { return *(ShardMailbox *)(memory + align(sizeof(pthread_barrier_t)) + s * mailboxBytes); }
+
+    RoadGhost *ghosts(int s, int direction) {
+        return (RoadGhost *)((char *)&mailbox(s) + ghostsOffset) + (size_t)direction * count;
+    }
+
+    RoadMigrant *migrants(int s, int direction) {
+        return (RoadMigrant *)((char *)&mailbox(s) + migrantsOffset) + (size_t)direction * count;
+    }
+
+    int behind() const { return (shard + shards - 1) % shards; }
+
+    int ahead() const { return (shard + 1) % shards; }
+
+    int ownerOf(double position) const {
+        int s = (int)(position / segment);
+        return s < shards ? s : shards - 1;
+    }
+
+    void wait() { pthread_barrier_wait(barrier); }
+
+    static uint32_t mix(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352d;
+        x ^= x >> 15;
+        x *= 0x846ca68b;
+        x ^= x >> 16;
+        return x;
+    }
+
+    std::unique_ptr<Planning> newVehicle() {
+        if(spare.empty()) return std::unique_ptr<Planning>(new Planning());
+        std::unique_ptr<Planning> vehicle = std::move(spare.back());
+        spare.pop_back();
+        return vehicle;
+    }
+
+    /* vehicle i starts spread evenly along the road in a pseudo-random lane and cruise speed */
+    void populate() {
+        VehicleState state;
+        for (uint32_t i = 0; i < count; i++) {
+            double position = (i + 0.5) * length / count;
+            if(ownerOf(position) != shard) continue;
+            RoadVehicle road;
+            road.id = i;
+            road.position = position;
+            road.vehicle = newVehicle();
+            road.vehicle->applyVehicleInput(2, 55 + mix(i) % 30);
+            road.vehicle->saveState(state);
+            state.gps = GPS(true, false, ROAD_LANES, 1 + mix(i) / 31 % ROAD_LANES);
+            road.vehicle->restoreState(state);
+            vehicles.push_back(std::move(road));
+        }
+    }
+
+    void emigrate() {
+        ShardMailbox &out = mailbox(shard);
+        out.migrantCount[0] = out.migrantCount[1] = 0;
+        for (size_t i = 0; i < vehicles.size();) {
+            RoadVehicle &road = vehicles[i];
+            if(ownerOf(road.position) == shard) {
+                i++;
+                continue;
+            }
+            // moves are capped at a segment, so the new owner is always a neighbour
+            int direction = ownerOf(road.position) == ahead() && road.vehicle->getSpeed() >= 0 ? 1 : 0;
+            RoadMigrant &migrant = migrants(shard, direction)[out.migrantCount[direction]++];
+            migrant.id = road.id;
+            migrant.position = road.position;
+            road.vehicle->saveState(migrant.state);
+            spare.push_back(std::move(road.vehicle));
+            if(i + 1 < vehicles.size()) road = std::move(vehicles.back());
+            vehicles.pop_back();
+            result.migrations++;
+        }
+    }
+
+    void adopt(int from, int direction) {
+        ShardMailbox &in = mailbox(from);
+        for (uint32_t i = 0; i < in.migrantCount[direction]; i++) {
+            const RoadMigrant &migrant = migrants(from, direction)[i];
+            RoadVehicle road;
+            road.id = migrant.id;
+            road.position = migrant.position;
+            road.vehicle = newVehicle();
+            road.vehicle->restoreState(migrant.state);
+            vehicles.push_back(std::move(road));
+        }
+    }
+
+    void publishHalo() {
+        ShardMailbox &out = mailbox(shard);
+        out.ghostCount[0] = out.ghostCount[1] = 0;
+        double begin = shard * segment;
+        double end = shard == shards - 1 ? length : (shard + 1) * segment;
+        for (size_t i = 0; i < vehicles.size(); i++) {
+            const RoadVehicle &road = vehicles[i];
+            RoadGhost ghost = {road.id, road.vehicle->getLane(), road.position};
+            if(road.position - begin <= SENSOR_RANGE) ghosts(shard, 0)[out.ghostCount[0]++] = ghost;
+            if(end - road.position <= SENSOR_RANGE) ghosts(shard, 1)[out.ghostCount[1]++] = ghost;
+        }
+    }
+
+    void addSightings(int from, int direction) {
+        const RoadGhost *halo = ghosts(from, direction);
+        uint32_t n = mailbox(from).ghostCount[direction];
+        for (uint32_t i = 0; i < n; i++) {
+            Sighting s = {std::clamp(halo[i].lane, 1, ROAD_LANES), halo[i].position, halo[i].id, -1};
+            sightings.push_back(s);
+        }
+        result.ghosts += n;
+    }
+
+    /* gap to the next sighting in the lane going one way round the ring, INT_MAX past the sensors */
+    double gap(size_t k, int lane, bool forward) const {
+        size_t first = laneStart[lane], last = laneStart[lane + 1];
+        if(last - first < 2) return INT_MAX;
+        size_t j = forward ? (k + 1 == last ? first : k + 1) : (k == first ? last - 1 : k - 1);
+        double d = forward ? sightings[j].position - sightings[k].position : sightings[k].position - sightings[j].position;
+        if(d < 0) d += length;
+        return d <= SENSOR_RANGE ? d : INT_MAX;
+    }
+
+    bool alongside(int lane, double position) const {
+        if(lane < 1 || lane > ROAD_LANES) return false;
+        const Sighting *first = sightings.data() + laneStart[lane], *last = sightings.data() + laneStart[lane + 1];
+        double low = position - SIDE_RANGE, high = position + SIDE_RANGE;
+        const Sighting *s = std::lower_bound(first, last, low < 0 ? 0 : low,
+                                             [](const Sighting &a, double p) { return a.position < p; });
+        if(s != last && s->position <= high) return true;
+        if(low < 0 && first != last && (last - 1)->position >= low + length) return true;
+        if(high >= length && first != last && first->position <= high - length) return true;
+        return false;
+    }
+
+    void sense() {
+        sightings.clear();
+        for (size_t i = 0; i < vehicles.size(); i++) {
+            Sighting s = {std::clamp(vehicles[i].vehicle->getLane(), 1, ROAD_LANES), vehicles[i].position,
+                          vehicles[i].id, (int32_t)i};
+            sightings.push_back(s);
+        }
+        if(shards > 1) {
+            addSightings(behind(), 1);
+            addSightings(ahead(), 0);
+        }
+        std::sort(sightings.begin(), sightings.end());
+
+        size_t next = 0;
+        for (int lane = 0; lane <= ROAD_LANES + 1; lane++) {
+            while (next < sightings.size() && sightings[next].lane < lane) next++;
+            laneStart[lane] = next;
+        }
+
+        for (size_t k = 0; k < sightings.size(); k++) {
+            const Sighting &s = sightings[k];
+            if(s.own < 0) continue;
+            vehicles[s.own].vehicle->sense(gap(k, s.lane, true), gap(k, s.lane, false),
+                                           alongside(s.lane - 1, s.position), alongside(s.lane + 1, s.position));
+        }
+    }
+
+    void step() {
+        for (size_t i = 0; i < vehicles.size(); i++) {
+            RoadVehicle &road = vehicles[i];
+            road.vehicle->stepHeadless();
+            if(road.vehicle->getLastRecord().events & EVENT_HARD_BRAKE) result.hardBrakes++;
+            double move = road.vehicle->getSpeed() * FEET_PER_MPH_TICK;
+            move = std::clamp(move, -segment, segment);
+            road.position = fmod(road.position + move, length);
+            if(road.position < 0) road.position += length;
+        }
+    }
+
+    void work(long ticks) {
+        populate();
+        for (long t = 0; t < ticks; t++) {
+            emigrate();
+            wait();
+            if(shards > 1) {
+                adopt(behind(), 1);
+                adopt(ahead(), 0);
+            }
+            publishHalo();
+            wait();
+            sense();
+            step();
+        }
+
+        result.vehicles = vehicles.size();
+        for (size_t i = 0; i < vehicles.size(); i++) {
+            result.fleetHash ^= chainTelemetryHash(0, vehicles[i].vehicle->getLastRecord().chain_hash, vehicles[i].id);
+            result.speed += vehicles[i].vehicle->getSpeed();
+        }
+        mailbox(shard).result = result;
+    }
+
+    public:
+
+    ShardedRoad() {
+        shards = 0;
+        count = 0;
+        length = 0;
+        segment = 0;
+        memory = NULL;
+        mappedBytes = 0;
+        barrier = NULL;
+        shard = -1;
+        memset(&result, 0, sizeof(result));
+    }
+
+    ~ShardedRoad() {
+        if(memory != NULL) {
+            if(shard < 0) pthread_barrier_destroy(barrier);
+            munmap(memory, mappedBytes);
+        }
+    }
+
+    /* maps the mailboxes, error says why the road can't be split that way */
+    bool open(int shardCount, uint32_t vehicleCount, double roadLength, std::string &error) {
+        if(shardCount < 1 || vehicleCount == 0) {
+            error = "need at least one shard and one vehicle";
+            return false;
+        }
+        shards = shardCount;
+        count = vehicleCount;
+        length = roadLength;
+        segment = length / shards;
+        if(shards > 1 && segment < 2 * SENSOR_RANGE) {
+            error = "segments must be at least " + std::to_string((int)(2 * SENSOR_RANGE)) + " feet, use a longer road";
+            return false;
+        }
+
+        // outboxes are sized for the whole fleet and only touched pages get memory
+        ghostsOffset = align(sizeof(ShardMailbox));
+        migrantsOffset = ghostsOffset + align(2 * (size_t)count * sizeof(RoadGhost));
+        mailboxBytes = migrantsOffset + align(2 * (size_t)count * sizeof(RoadMigrant));
+        mappedBytes = align(sizeof(pthread_barrier_t)) + shards * mailboxBytes;
+        void *mapped = mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(mapped == MAP_FAILED) {
+            error = "cannot map the shard mailboxes";
+            return false;
+        }
+        memory = (char *)mapped;
+        barrier = (pthread_barrier_t *)memory;
+        pthread_barrierattr_t attributes;
+        pthread_barrierattr_init(&attributes);
+        pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_barrier_init(barrier, &attributes, shards);
+        pthread_barrierattr_destroy(&attributes);
+        return true;
+    }
+
+    /* forks a worker per shard and waits for them, false if any failed */
+    bool run(long ticks) {
+        std::vector<pid_t> workers;
+        for (int s = 0; s < shards; s++) {
+            pid_t pid = fork();
+            if(pid == 0) {
+                shard = s;
+                work(ticks);
+                _exit(0);
+            }
+            if(pid < 0) break;
+            workers.push_back(pid);
+        }
+
+        // a worker that dies leaves the others stuck at the barrier, so they are stopped too
+        bool ok = workers.size() == (size_t)shards;
+        if(!ok) for (size_t i = 0; i < workers.size(); i++) kill(workers[i], SIGKILL);
+        for (size_t done = 0; done < workers.size(); done++) {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if(pid < 0) break;
+            if(ok && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+                ok = false;
+                for (size_t i = 0; i < workers.size(); i++) kill(workers[i], SIGKILL);
+            }
+        }
+        return ok;
+    }
+
+    /* the shards' results added up, after run() */
+    ShardResult total() {
+        ShardResult sum;
+        memset(&sum, 0, sizeof(sum));
+        for (int s = 0; s < shards; s++) {
+            const ShardResult &r = mailbox(s).result;
+            sum.fleetHash ^= r.fleetHash;
+            sum.migrations += r.migrations;
+            sum.hardBrakes += r.hardBrakes;
+            sum.ghosts += r.ghosts;
+            sum.vehicles += r.vehicles;
+            sum.speed += r.speed;
+        }
+        return sum;
+    }
+
+};
+
+#endif
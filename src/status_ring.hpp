@@ -0,0 +1,240 @@
+#ifndef STATUS_RING_HPP
+#define STATUS_RING_HPP
+
+#include <stdint.h>
+#include <cstring>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vehicle.hpp"
+
+/* Shared-memory ring of per-tick status entries for external dashboards.
+   One writer, any number of readers. Every slot carries a seqlock sequence number: odd while
+   the writer is filling it, even when stable. Readers copy the entry and retry if the sequence
+   moved, so they never block the writer and need no syscalls after mapping the ring. */
+
+static const uint32_t STATUS_RING_MAGIC = 0x414c5352;    // "ALSR"
+static const uint32_t STATUS_RING_VERSION = 2;
+
+struct status_entry {
+    uint64_t tick;
+    double velocity;
+    double distance_in_front;
+    double distance_behind;
+    double light_level;
+    struct status_struct status;
+};
+
+struct status_slot {
+    std::atomic<uint64_t> sequence;
+    uint64_t index;                 // which entry the slot holds, it is reused every lap of the ring
+    status_entry entry;
+};
+
+struct status_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;              // number of slots, a power of two
+    uint32_t entry_size;            // sizeof(status_entry), checked by readers
+    uint32_t writer_pid;            // a ring whose writer is gone can be replaced
+    uint32_t unused;
+    std::atomic<uint64_t> next;     // number of entries ever published
+};
+
+inline size_t statusRingBytes(uint32_t capacity) {
+    return sizeof(status_ring_header) + (size_t)capacity * sizeof(status_slot);
+}
+
+
+class StatusRingWriter {
+
+    private:
+
+    status_ring_header *header;
+    status_slot *slots;
+    size_t mappedBytes;
+    char name[64];
+
+    /* unlinks shmName if it holds a ring whose writer process no longer exists */
+    static bool removeStale(const char *shmName) {
+        int fd = shm_open(shmName, O_RDONLY, 0);
+        if(fd < 0) return errno == ENOENT;
+        struct stat st;
+        bool stale = false;
+        if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(status_ring_header)) {
+            void *memory = mmap(NULL, sizeof(status_ring_header), PROT_READ, MAP_SHARED, fd, 0);
+            if(memory != MAP_FAILED) {
+                const status_ring_header *old = (const status_ring_header *)memory;
+                stale = old->magic == STATUS_RING_MAGIC && old->writer_pid != 0
+                     && kill((pid_t)old->writer_pid, 0) != 0 && errno == ESRCH;
+                munmap(memory, sizeof(status_ring_header));
+            }
+        }
+        ::close(fd);
+        return stale && (shm_unlink(shmName) == 0 || errno == ENOENT);
+    }
+
+    public:
+
+    StatusRingWriter() {
+        header = NULL;
+        slots = NULL;
+        mappedBytes = 0;
+        name[0] = '\0';
+    }
+
+    ~StatusRingWriter() { close(); }
+
+    /* creates the shared-memory object, capacity is rounded up to a power of two. A ring left
+       behind by a writer that died is replaced, otherwise fails with errno EEXIST if the name is
+       taken: truncating a live ring would fault the dashboards still reading it. */
+    bool open(const char *shmName, uint32_t capacity) {
+        close();
+        uint32_t slotsWanted = 1;
+        while (slotsWanted < capacity) slotsWanted <<= 1;
+
+        int fd = shm_open(shmName, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if(fd < 0 && errno == EEXIST) {
+            if(!removeStale(shmName)) {
+                errno = EEXIST;
+                return false;
+            }
+            fd = shm_open(shmName, O_CREAT | O_EXCL | O_RDWR, 0644);
+        }
+        if(fd < 0) return false;
+        mappedBytes = statusRingBytes(slotsWanted);
+        if(ftruncate(fd, mappedBytes) != 0) {
+            ::close(fd);
+            shm_unlink(shmName);
+            return false;
+        }
+        void *memory = mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(memory == MAP_FAILED) {
+            shm_unlink(shmName);
+            return false;
+        }
+
+        header = (status_ring_header *)memory;
+        slots = (status_slot *)(header + 1);
+        header->capacity = slotsWanted;
+        header->entry_size = sizeof(status_entry);
+        header->version = STATUS_RING_VERSION;
+        header->writer_pid = (uint32_t)getpid();
+        header->unused = 0;
+        header->next.store(0, std::memory_order_relaxed);
+        // readers check the magic last, so they never see a half-initialized header
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = STATUS_RING_MAGIC;
+
+        strncpy(name, shmName, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+        return true;
+    }
+
+    bool isOpen() const { return header != NULL; }
+
+    void publish(const status_entry &entry) {
+        if(header == NULL) return;
+        uint64_t index = header->next.load(std::memory_order_relaxed);
+        status_slot &slot = slots[index & (header->capacity - 1)];
+        uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.index = index;
+        slot.entry = entry;
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        header->next.store(index + 1, std::memory_order_release);
+    }
+
+    void close() {
+        if(header != NULL) {
+            munmap(header, mappedBytes);
+            shm_unlink(name);
+        }
+        header = NULL;
+        slots = NULL;
+    }
+
+};
+
+
+class StatusRingReader {
+
+    private:
+
+    const status_ring_header *header;
+    const status_slot *slots;
+    size_t mappedBytes;
+
+    public:
+
+    StatusRingReader() {
+        header = NULL;
+        slots = NULL;
+        mappedBytes = 0;
+    }
+
+    ~StatusRingReader() { if(header != NULL) munmap((void *)header, mappedBytes); }
+
+    bool open(const char *shmName) {
+        int fd = shm_open(shmName, O_RDONLY, 0);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(status_ring_header)) {
+            ::close(fd);
+            return false;
+        }
+        void *memory = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(memory == MAP_FAILED) return false;
+
+        header = (const status_ring_header *)memory;
+        mappedBytes = st.st_size;
+        if(header->magic != STATUS_RING_MAGIC || header->version != STATUS_RING_VERSION
+           || header->entry_size != sizeof(status_entry) || statusRingBytes(header->capacity) > mappedBytes) {
+            munmap(memory, mappedBytes);
+            header = NULL;
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        slots = (const status_slot *)(header + 1);
+        return true;
+    }
+
+    /* number of entries the writer has published so far */
+    uint64_t published() const { return header->next.load(std::memory_order_acquire); }
+
+    uint32_t capacity() const { return header->capacity; }
+
+    /* copies entry number index, false if it was overwritten or not written yet */
+    bool read(uint64_t index, status_entry &out) const {
+        uint64_t next = published();
+        if(index >= next || next - index > header->capacity) return false;
+        const status_slot &slot = slots[index & (header->capacity - 1)];
+        for (int attempt = 0; attempt < 64; attempt++) {
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if(before & 1) continue;
+            uint64_t held = slot.index;
+            memcpy(&out, (const void *)&slot.entry, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.sequence.load(std::memory_order_relaxed) != before) continue;
+            // the slot may already hold a newer lap of the ring
+            return held == index;
+        }
+        return false;
+    }
+
+    bool readLatest(status_entry &out) const {
+        uint64_t next = published();
+        return next > 0 && read(next - 1, out);
+    }
+
+};
+
+#endif
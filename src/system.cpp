@@ -1,8 +1,18 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <random>
 
 #include "vehicle.cpp"
+#include "credentials.hpp"
+#include "scenario.hpp"
+#include "drivers.hpp"
+#include "shards.hpp"
+#include "inputlog.hpp"
 
 using namespace std;
 
@@ -18,6 +28,8 @@ class SystemManagement {
     
     map<string,string> passwords;
     map<string,string> users;
+
+    CredentialStore store;    // prebuilt accounts, the built-in ones are only loaded without it
     
     void init_credentials()
     {
@@ -36,7 +48,40 @@ class SystemManagement {
     
     SystemManagement() {
         loggedIn = false;
-        init_credentials();
+    }
+
+    bool open_store(const char *path) { return store.open(path); }
+
+    /* logs in and returns true, or prints why the login failed */
+    bool login(const string &name, const string &pass)
+    {
+        if(name.empty()) {
+            cout << "Login Failed: Invalid username." << endl;
+            return false;
+        }
+        if(store.isOpen()) {
+            const credential_record *record = store.find(name.c_str());
+            if(record == NULL) {
+                cout << "Login Failed: Invalid username." << endl;
+            } else if(CredentialStore::verify(record, pass.c_str())) {
+                loggedIn = true;
+                user = record->full_name;
+            } else {
+                cout << "Login Failed: Invalid password." << endl;
+            }
+            return loggedIn;
+        }
+
+        if(passwords.empty()) init_credentials();
+        if(passwords.count(name) == 0) {
+            cout << "Login Failed: Invalid username." << endl;
+        } else if(passwords[name].compare(pass) == 0) {
+            loggedIn = true;
+            user = users[name];
+        } else {
+            cout << "Login Failed: Invalid password." << endl;
+        }
+        return loggedIn;
     }
     
     void login_prompt()
@@ -50,27 +95,274 @@ class SystemManagement {
             cout << "Password: ";
             cin >> password;
             
-            if(passwords.count(username) == 0) {
-                cout << "Login Failed: Invalid username." << endl;
-            } else if(passwords[username].compare(password) == 0) {
-                loggedIn = true;
-                user = users[username];
-            } else {
-                cout << "Login Failed: Invalid password." << endl;
-            }
+            login(username, password);
         }
     }
     string get_user() { return user; }
 };
 
-int main(int argc, char *argv[]) {
-    
+bool enable_rear_camera(Planning &vehicle, const char *rear_camera) {
+    if (rear_camera == NULL) return true;
+    bool synthetic = strcmp(rear_camera, "synthetic") == 0;
+    if (vehicle.enableRearCamera(synthetic ? NULL : rear_camera)) return true;
+    cout << "Could not read rear camera frames from " << rear_camera << endl;
+    return false;
+}
+
+/* prints the first tick where two runs differ, returns 0 if they match */
+int report_divergence(const telemetry_record *expected, size_t expected_count,
+                      const telemetry_record *actual, size_t actual_count) {
+    long tick = firstDivergence(expected, expected_count, actual, actual_count);
+    if (tick < 0) {
+        cout << "Runs match over " << expected_count << " ticks" << endl;
+        return 0;
+    }
+    cout << "Runs diverge at tick " << tick << endl;
+    if ((size_t)tick >= expected_count || (size_t)tick >= actual_count) {
+        cout << "  one run ends after " << tick << " ticks" << endl;
+        return 1;
+    }
+    const telemetry_record &a = expected[tick];
+    const telemetry_record &b = actual[tick];
+    cout << "  state hash " << hex << a.state_hash << " vs " << b.state_hash << dec << endl;
+    cout << "  velocity " << a.velocity << " vs " << b.velocity << endl;
+    cout << "  distance in front " << a.distance_in_front << " vs " << b.distance_in_front << endl;
+    cout << "  distance behind " << a.distance_behind << " vs " << b.distance_behind << endl;
+    cout << "  gear " << a.status.gear << " vs " << b.status.gear << ", lane " << a.status.lane << " vs " << b.status.lane << endl;
+    cout << "  inputs applied " << a.input_count << " vs " << b.input_count << endl;
+    return 1;
+}
+
+int compare_runs(const char *expected_path, const char *actual_path) {
+    TelemetryLog expected, actual;
+    if (!expected.open(expected_path)) {
+        cout << expected_path << ": " << expected.getError() << endl;
+        return 2;
+    }
+    if (!actual.open(actual_path)) {
+        cout << actual_path << ": " << actual.getError() << endl;
+        return 2;
+    }
+    return report_divergence(expected.records(), expected.size(), actual.records(), actual.size());
+}
+
+/* re-runs a recording's inputs headless and checks the new run against it */
+int replay_run(const char *path, const char *record_path, const char *rear_camera) {
+    TelemetryLog recorded;
+    if (!recorded.open(path)) {
+        cout << path << ": " << recorded.getError() << endl;
+        return 2;
+    }
+    TelemetryWriter writer;
+    if (record_path != NULL && !writer.open(record_path)) {
+        cout << "Could not write " << record_path << endl;
+        return 2;
+    }
+
+    Planning vehicle = Planning();
+    if (!enable_rear_camera(vehicle, rear_camera)) return 2;
+    if (record_path != NULL) vehicle.setTelemetry(&writer);
+
+    vector<telemetry_record> replayed;
+    replayed.reserve(recorded.size());
+    size_t next_input = 0;
+    for (size_t i = 0; i < recorded.size(); i++) {
+        const telemetry_record &original = recorded.records()[i];
+        if (next_input + original.input_count > recorded.getInputCount()) {
+            cout << "The inputs of " << path << " end before tick " << original.tick << ", is "
+                 << telemetryInputsPath(path) << " missing?" << endl;
+            return 2;
+        }
+        vehicle.tick();
+        for (uint32_t n = 0; n < original.input_count; n++) {
+            const telemetry_input &input = recorded.inputs()[next_input++];
+            if (input.menu == TELEMETRY_ENVIRONMENT) vehicle.applyEnvironmentInput(input.code, input.value);
+            else vehicle.applyVehicleInput(input.code, input.value);
+        }
+        vehicle.updateDisplay();
+        vehicle.endTick();
+        replayed.push_back(vehicle.getLastRecord());
+    }
+    return report_divergence(recorded.records(), recorded.size(), replayed.data(), replayed.size());
+}
+
+bool load_scenario(ScenarioProgram &program, const char *path) {
+    ifstream file(path);
+    if (!file) {
+        cout << "Could not read scenario " << path << endl;
+        return false;
+    }
+    stringstream source;
+    source << file.rdbuf();
+    if (!program.compile(source.str(), Planning::TICKS_PER_SECOND)) {
+        cout << path << ":" << program.getError() << endl;
+        return false;
+    }
+    return true;
+}
+
+/* parses a whole input log, reporting the first bad line or how fast it went */
+int check_input_log(const char *path) {
+    InputLog log;
+    if (!log.open(path)) {
+        cout << path << ": " << log.getError() << endl;
+        return 1;
+    }
+    vector<InputCommand> batch(65536);
+    uint64_t last_tick = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t n;
+    while ((n = log.read(batch.data(), batch.size())) > 0) last_tick = batch[n - 1].tick;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (log.failed()) {
+        cout << path << ":" << log.getError() << endl;
+        return 1;
+    }
+    cout << log.getCommandCount() << " commands up to tick " << last_tick << ", " << log.getSize() << " bytes in "
+         << seconds << " s (" << log.getSize() / seconds / 1e9 << " GB/s)" << endl;
+    return 0;
+}
+
+#ifdef TABLE_CHECK
+/* trajectory table answers against step-by-step runs, a third of the speeds on or just under
+   the edges the tables found by bisection */
+int check_tables(long samples) {
+    mt19937_64 random(1);
+    uniform_real_distribution<double> speeds(-5.0, 210.0);
+    const TrajectoryTables &tables = trajectoryTables(*activeRules.enter());
+    for (long i = 0; i < samples; i++) {
+        int intensity = 1 + random() % 3;
+        int target = random() % 202;
+        double speed = speeds(random);
+        if (i % 6 == 1) speed = floor(speed);
+        if (i % 3 == 2) {
+            speed = tables.stepNear(speed, intensity, target, random() % 4);
+            if (random() % 2) speed = nextafter(speed, 0.0);
+        }
+        double gap = (double)(Numeric)(random() % 2 ? (double)(random() % 500) : speeds(random) + 5);
+        if (!tables.agreesWithSimulation(speed, gap, intensity, target)) {
+            cout << setprecision(17) << "speed " << speed << ", gap " << gap << ", intensity " << intensity
+                 << ", target " << target << ": tables " << tables.ticksToStop(speed, intensity) << " ticks to stop, gap "
+                 << tables.gapAfterStop(speed, gap, intensity) << ", " << tables.ticksToSpeed(speed, target)
+                 << " ticks to target, simulation differs" << endl;
+            activeRules.leave();
+            return 1;
+        }
+    }
+    activeRules.leave();
+    cout << samples << " starts, tables agree with simulation" << endl;
+    return 0;
+}
+#endif
+
+#ifdef PARSE_CHECK
+/* random lines, mostly the shapes the quick path takes and their near misses, parsed both ways */
+int check_quick_path(long lines) {
+    mt19937_64 random(1);
+    auto chance = [&](int percent) { return (long)(random() % 100) < percent; };
+    auto digits = [&](string &out, int count) {
+        for (int i = 0; i < count; i++) out += (char)('0' + random() % 10);
+    };
+    auto run = [&]() -> int {
+        int r = random() % 100;
+        return r < 80 ? 1 + r % 8 : r < 95 ? r % 12 : 20 + r % 30;
+    };
+    auto blank = [&](string &out) { out += chance(85) ? " " : chance(50) ? "  " : chance(50) ? "\t" : ""; };
+
+    InputLog log;
+    long quick_lines = 0;
+    for (long i = 0; i < lines; i++) {
+        string line;
+        if (chance(3)) blank(line);
+        digits(line, run());
+        blank(line);
+        line += chance(96) ? (chance(50) ? 'E' : 'V') : chance(50) ? 'X' : '-';
+        blank(line);
+        digits(line, chance(90) ? 1 : random() % 3);
+        if (chance(70)) {
+            blank(line);
+            if (chance(30)) line += '-';
+            digits(line, run());
+        }
+        if (chance(5)) line += chance(50) ? " # note" : chance(50) ? " " : "x";
+        if (chance(98)) line += '\n';
+        while (line.size() < 48) line += chance(80) ? (char)('0' + random() % 10) : chance(50) ? ' ' : '\n';
+
+        bool quick;
+        uint64_t previous = chance(90) ? 0 : random() % 100000000;
+        if (!log.quickPathAgrees(line.data(), line.size(), previous, quick)) {
+            string shown = line.substr(0, line.find('\n'));
+            cout << "after tick " << previous << ", the quick path misreads \"" << shown << "\"" << endl;
+            return 1;
+        }
+        quick_lines += quick;
+    }
+    cout << lines << " lines, " << quick_lines << " on the quick path, all read as parseLine reads them" << endl;
+    return quick_lines > 0 ? 0 : 1;
+}
+#endif
+
+/* headless vehicles, each with a driver of driver_kind (all kinds in turn if -1) and the scenario if there is one */
+int run_fleet(long count, long ticks, int driver_kind, const ScenarioProgram *scenario) {
+    vector<Planning> vehicles(count);
+    vector<ScenarioInstance> scripts;
+    if (scenario != NULL) scripts.assign(count, ScenarioInstance(*scenario));
+
+    DriverScheduler drivers;
+    for (long i = 0; i < count; i++) {
+        int kind = driver_kind >= 0 ? driver_kind : i % DRIVER_KINDS;
+        drivers.spawn(vehicles[i], makeDriver(kind, vehicles[i], (uint32_t)(i + 1) * 2654435761u));
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (long t = 0; t < ticks; t++) {
+        for (long i = 0; i < count; i++) {
+            vehicles[i].tick();
+            if (!scripts.empty()) scripts[i].apply(vehicles[i]);
+        }
+        drivers.runTick(t);
+        for (long i = 0; i < count; i++) {
+            vehicles[i].updateDisplay();
+            vehicles[i].endTick();
+            tickArena.reset();
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double speed = 0;
+    for (long i = 0; i < count; i++) speed += vehicles[i].getSpeed();
+    cout << count << " vehicles, " << ticks << " ticks in " << seconds << " s, "
+         << drivers.getResumeCount() << " driver resumes, " << driverFrames.getReservedBytes() / 1024
+         << " KB of driver frames, average speed " << speed / count << endl;
+    return 0;
+}
+
+/* the fleet on a ring road split between worker processes, prints a hash that doesn't depend on the split */
+int run_shards(int shards, long count, long ticks, double road_length) {
+    ShardedRoad road;
+    string error;
+    if (!road.open(shards, count, road_length, error)) {
+        cout << "Cannot shard the road: " << error << endl;
+        return 1;
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (!road.run(ticks)) {
+        cout << "A shard worker failed" << endl;
+        return 1;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ShardResult total = road.total();
+    cout << total.vehicles << " vehicles on " << shards << " shards, " << ticks << " ticks in " << seconds << " s, "
+         << total.migrations << " migrations, " << total.ghosts << " halo entries, " << total.hardBrakes
+         << " hard brakes, average speed " << total.speed / total.vehicles << ", fleet hash " << hex
+         << total.fleetHash << dec << endl;
+    return total.vehicles == count ? 0 : 1;
+}
+
+void show_progress_bar() {
     int total_steps = 100;
     int curr_step = 0;
-    SystemManagement system;
-    system.login_prompt();
-    
-    cout << "\nWelcome " << system.get_user() << endl;
     while (curr_step <= total_steps) {
         float percent_complete = static_cast<float>(curr_step) / total_steps * 100;
         std::cout << "[";
@@ -93,8 +385,208 @@ int main(int argc, char *argv[]) {
         std::cout.flush();
     }
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+int main(int argc, char *argv[]) {
+    
+    const char *rear_camera = NULL;    // "synthetic" or a file of raw frames
+#ifdef ALLOC_CHECK
+    int alloc_check_ticks = 0;         // only the alloccheck build runs these
+#endif
+#ifdef TABLE_CHECK
+    long table_check_samples = 0;      // only the tablecheck build runs these
+#endif
+#ifdef PARSE_CHECK
+    long parse_check_lines = 0;        // only the parsecheck build runs these
+#endif
+    const char *record_path = NULL;    // telemetry output, one record per tick
+    const char *replay_path = NULL;    // recorded run to replay and check
+    const char *compare_paths[2] = {NULL, NULL};
+    bool sync_render = false;          // print frames inside the control loop instead of a render thread
+    const char *status_shm = NULL;     // shared-memory name to publish every tick's status under
+    bool fast_start = false;           // skip the progress bar
+    const char *credentials_path = NULL;
+    const char *login_user = NULL;     // log in without the prompt, password from ALSET_PASSWORD
+    const char *scenario_path = NULL;  // script that drives the menu inputs
+    long headless_ticks = 0;           // run this many ticks without the terminal UI, then exit
+    const char *driver_name = NULL;    // driver agent for the vehicle, "mixed" cycles through all of them
+    long fleet_size = 0;               // headless vehicles to run with drivers instead of one interactive one
+    int shard_count = 0;               // run the fleet on a road split between this many processes instead
+    double road_length = 0;            // feet, 0 for 200 per vehicle
+    const char *rules_path = NULL;     // control thresholds, reloaded whenever the file changes
+    const char *input_log_path = NULL; // recorded menu inputs, applied as their ticks come up
+    const char *check_log_path = NULL; // only parse an input log and report on it
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rear-camera") == 0 && i + 1 < argc) rear_camera = argv[++i];
+#ifdef ALLOC_CHECK
+        else if (strcmp(argv[i], "--alloc-check") == 0 && i + 1 < argc) alloc_check_ticks = atoi(argv[++i]);
+#endif
+#ifdef TABLE_CHECK
+        else if (strcmp(argv[i], "--table-check") == 0 && i + 1 < argc) table_check_samples = atol(argv[++i]);
+#endif
+#ifdef PARSE_CHECK
+        else if (strcmp(argv[i], "--parse-check") == 0 && i + 1 < argc) parse_check_lines = atol(argv[++i]);
+#endif
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay_path = argv[++i];
+        else if (strcmp(argv[i], "--sync-render") == 0) sync_render = true;
+        else if (strcmp(argv[i], "--publish-status") == 0 && i + 1 < argc) status_shm = argv[++i];
+        else if (strcmp(argv[i], "--fast") == 0) fast_start = true;
+        else if (strcmp(argv[i], "--credentials") == 0 && i + 1 < argc) credentials_path = argv[++i];
+        else if (strcmp(argv[i], "--user") == 0 && i + 1 < argc) login_user = argv[++i];
+        else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) scenario_path = argv[++i];
+        else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) headless_ticks = atol(argv[++i]);
+        else if (strcmp(argv[i], "--driver") == 0 && i + 1 < argc) driver_name = argv[++i];
+        else if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc) fleet_size = atol(argv[++i]);
+        else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) shard_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--road") == 0 && i + 1 < argc) road_length = atof(argv[++i]);
+        else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) rules_path = argv[++i];
+        else if (strcmp(argv[i], "--input-log") == 0 && i + 1 < argc) input_log_path = argv[++i];
+        else if (strcmp(argv[i], "--check-log") == 0 && i + 1 < argc) check_log_path = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            compare_paths[0] = argv[++i];
+            compare_paths[1] = argv[++i];
+        }
+    }
+
+    if (compare_paths[0] != NULL) return compare_runs(compare_paths[0], compare_paths[1]);
+    if (check_log_path != NULL) return check_input_log(check_log_path);
+#ifdef PARSE_CHECK
+    if (parse_check_lines > 0) return check_quick_path(parse_check_lines);
+#endif
+
+    RuleWatcher rules_watcher;
+    string rules_error;
+    if (rules_path != NULL && !rules_watcher.start(activeRules, rules_path, rules_error)) {
+        cout << rules_path << ": " << rules_error << endl;
+        return 1;
+    }
+#ifdef TABLE_CHECK
+    if (table_check_samples > 0) return check_tables(table_check_samples);
+#endif
+    if (replay_path != NULL) return replay_run(replay_path, record_path, rear_camera);
+
+    ScenarioProgram scenario;
+    if (scenario_path != NULL && !load_scenario(scenario, scenario_path)) return 1;
+    ScenarioInstance scenario_run(scenario);
+
+    InputLog input_log;
+    if (input_log_path != NULL && !input_log.open(input_log_path)) {
+        cout << input_log_path << ": " << input_log.getError() << endl;
+        return 1;
+    }
+    InputLogPlayer input_player(input_log);
+
+    int driver_kind = -1;
+    if (driver_name != NULL && strcmp(driver_name, "mixed") != 0) {
+        driver_kind = driverKind(driver_name);
+        if (driver_kind < 0) {
+            cout << "Unknown driver " << driver_name << ", expected mixed";
+            for (int i = 0; i < DRIVER_KINDS; i++) cout << ", " << driverKindNames[i];
+            cout << endl;
+            return 1;
+        }
+    }
+
+#ifdef ALLOC_CHECK
+    // headless steady-state ticks, fails if any of them touched the heap
+    if (alloc_check_ticks > 0) {
+        Planning vehicle = Planning();
+        vehicle.enableRearCamera(NULL);
+        if (scenario_path != NULL) vehicle.addTickInputs(&scenario_run);
+        if (input_log_path != NULL) vehicle.addTickInputs(&input_player);
+        DriverScheduler driver;
+        if (driver_name != NULL) {
+            driver.spawn(vehicle, makeDriver(driver_kind >= 0 ? driver_kind : DRIVER_COMMUTER, vehicle, 1));
+            vehicle.addTickInputs(&driver);
+        }
+        size_t length;
+        vehicle.stepHeadless();
+        vehicle.renderDisplay(length);
+        tickArena.reset();
+
+        unsigned long before = allocationCount.load();
+        for (int i = 0; i < alloc_check_ticks; i++) {
+            vehicle.stepHeadless();
+            if (vehicle.renderDisplay(length) == NULL) {
+                cout << "tick " << i << ": frame did not fit in the tick arena" << endl;
+                return 1;
+            }
+            tickArena.reset();
+        }
+        unsigned long allocations = allocationCount.load() - before;
+        cout << alloc_check_ticks << " ticks, " << allocations << " heap allocations, "
+             << tickArena.getHighWater() << " arena bytes per tick" << endl;
+        return allocations == 0 ? 0 : 1;
+    }
+#endif
+
+    SystemManagement system;
+    if (credentials_path != NULL && !system.open_store(credentials_path)) {
+        cout << "Could not open credential store " << credentials_path << endl;
+        return 1;
+    }
+    if (login_user != NULL) {
+        // non-interactive login for scripted runs, the password never appears on the command line
+        const char *login_password = getenv("ALSET_PASSWORD");
+        if (!system.login(login_user, login_password != NULL ? login_password : "")) return 1;
+    } else {
+        system.login_prompt();
+    }
+    
+    cout << "\nWelcome " << system.get_user() << endl;
+    if (fleet_size > 0 && shard_count > 0) {
+        return run_shards(shard_count, fleet_size, headless_ticks > 0 ? headless_ticks : 100,
+                          road_length > 0 ? road_length : fleet_size * 200.0);
+    }
+    if (fleet_size > 0) return run_fleet(fleet_size, headless_ticks > 0 ? headless_ticks : 100, driver_kind,
+                                         scenario_path != NULL ? &scenario : NULL);
+    if (!fast_start) show_progress_bar();
 
     Planning running_vehicle = Planning();
+    if (!enable_rear_camera(running_vehicle, rear_camera)) return 1;
+
+    TelemetryWriter telemetry;
+    if (record_path != NULL) {
+        if (!telemetry.open(record_path)) {
+            cout << "Could not write telemetry to " << record_path << endl;
+            return 1;
+        }
+        running_vehicle.setTelemetry(&telemetry);
+    }
+
+    StatusRingWriter status_ring;
+    if (status_shm != NULL) {
+        if (!status_ring.open(status_shm, 1024)) {
+            if (errno == EEXIST) {
+                cout << "Shared memory " << status_shm << " is already published by a running simulator" << endl;
+            } else {
+                cout << "Could not create shared memory " << status_shm << endl;
+            }
+            return 1;
+        }
+        running_vehicle.setStatusRing(&status_ring);
+    }
+
+    if (scenario_path != NULL) running_vehicle.addTickInputs(&scenario_run);
+    if (input_log_path != NULL) running_vehicle.addTickInputs(&input_player);
+    DriverScheduler driver;
+    if (driver_name != NULL) {
+        driver.spawn(running_vehicle, makeDriver(driver_kind >= 0 ? driver_kind : DRIVER_COMMUTER, running_vehicle, 1));
+        running_vehicle.addTickInputs(&driver);
+    }
+    if (headless_ticks > 0) {
+        for (long i = 0; i < headless_ticks; i++) running_vehicle.stepHeadless();
+        if (input_log.failed()) {
+            cout << input_log_path << ":" << input_log.getError() << endl;
+            return 1;
+        }
+        const telemetry_record &last = running_vehicle.getLastRecord();
+        cout << headless_ticks << " ticks, speed " << running_vehicle.getSpeed() << ", state hash "
+             << hex << last.state_hash << dec << endl;
+        return 0;
+    }
 
-    running_vehicle.run_systems();
+    input_player.reportFailureAs(input_log_path);
+    running_vehicle.run_systems(!sync_render);
 }
@@ -0,0 +1,244 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vehicle.hpp"
+
+/* one fixed-size record per tick after a telemetry_header, written in host byte order. The inputs applied
+   during each tick go to a sidecar, <run>.inputs, in the order they were applied; a record only says how
+   many were its own. */
+
+static const uint32_t TELEMETRY_MAGIC = 0x4c455441;           // "ATEL"
+static const uint32_t TELEMETRY_INPUTS_MAGIC = 0x4e495441;    // "ATIN"
+static const uint32_t TELEMETRY_VERSION = 2;
+
+struct telemetry_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;        // sizeof the records or inputs that follow, a layout change alters it
+    uint32_t unused;
+};
+
+/* things the control logic did during a tick, telemetry_record.events */
+enum TelemetryEvent {
+    EVENT_HARD_BRAKE = 1 << 0,              // automatic braking at intensity 3
+    EVENT_LANE_CHANGE = 1 << 1,             // automaticallyChangeLane moved the vehicle
+    EVENT_LANE_CHANGE_REFUSED = 1 << 2,     // a signalled lane change was blocked
+    EVENT_HIGH_BEAMS_TOGGLED = 1 << 3,
+    EVENT_CC_DROPPED = 1 << 4,              // gearControl turned cruise control off
+    EVENT_REAR_CAMERA_ON = 1 << 5
+};
+
+struct telemetry_record {
+    uint64_t tick;
+    uint64_t state_hash;        // hash of every mutable field at the end of the tick
+    uint64_t chain_hash;        // state_hash folded into all earlier ticks, equal chains mean equal histories
+    double velocity;
+    double distance_in_front;
+    double distance_behind;
+    double light_level;
+    struct status_struct status;
+    uint32_t input_count;       // entries this tick added to the run's inputs
+    uint32_t events;            // TelemetryEvent bits
+};
+
+enum TelemetryInputMenu { TELEMETRY_ENVIRONMENT, TELEMETRY_VEHICLE };
+
+struct telemetry_input {
+    uint64_t tick;
+    uint32_t menu;              // TelemetryInputMenu
+    int32_t code;               // the menu's input code
+    int32_t value;
+    uint32_t unused;
+};
+
+inline std::string telemetryInputsPath(const char *run) { return std::string(run) + ".inputs"; }
+
+inline uint64_t chainTelemetryHash(uint64_t chain, uint64_t stateHash, uint64_t tick) {
+    uint64_t x = chain ^ (stateHash + 0x9e3779b97f4a7c15ULL * (tick + 1));
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+
+/* appends records and inputs through fixed stdio buffers, so recording a tick never allocates */
+
+class TelemetryWriter {
+
+    private:
+
+    FILE *file;
+    FILE *inputFile;
+    char buffer[64 * 1024];
+    char inputBuffer[16 * 1024];
+
+    public:
+
+    TelemetryWriter() {
+        file = NULL;
+        inputFile = NULL;
+    }
+
+    ~TelemetryWriter() { close(); }
+
+    bool open(const char *path) {
+        close();
+        file = fopen(path, "wb");
+        inputFile = fopen(telemetryInputsPath(path).c_str(), "wb");
+        if(file == NULL || inputFile == NULL) {
+            close();
+            return false;
+        }
+        setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+        setvbuf(inputFile, inputBuffer, _IOFBF, sizeof(inputBuffer));
+        telemetry_header header = {TELEMETRY_MAGIC, TELEMETRY_VERSION, (uint32_t)sizeof(telemetry_record), 0};
+        telemetry_header inputHeader = {TELEMETRY_INPUTS_MAGIC, TELEMETRY_VERSION, (uint32_t)sizeof(telemetry_input), 0};
+        if(fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(&inputHeader, sizeof(inputHeader), 1, inputFile) != 1) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void write(const telemetry_record &record) {
+        if(file != NULL) fwrite(&record, sizeof(record), 1, file);
+    }
+
+    void writeInput(const telemetry_input &input) {
+        if(inputFile != NULL) fwrite(&input, sizeof(input), 1, inputFile);
+    }
+
+    void close() {
+        if(file != NULL) fclose(file);
+        if(inputFile != NULL) fclose(inputFile);
+        file = NULL;
+        inputFile = NULL;
+    }
+
+};
+
+
+/* read-only view of a recorded run */
+
+class TelemetryLog {
+
+    private:
+
+    void *mapping;
+    size_t mappedBytes;
+    size_t count;
+    void *inputMapping;
+    size_t inputBytes;
+    size_t inputCount;
+    const char *error;
+
+    /* maps a file and checks its header, false with error set if it cannot be read or is another layout */
+    bool mapEntries(const char *path, uint32_t magic, size_t entrySize, void *&memory, size_t &bytes, size_t &entries) {
+        memory = NULL;
+        bytes = 0;
+        entries = 0;
+        int fd = ::open(path, O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0) {
+            if(fd >= 0) ::close(fd);
+            error = "cannot read";
+            return false;
+        }
+        if((size_t)st.st_size < sizeof(telemetry_header)) {
+            ::close(fd);
+            error = "not a telemetry recording";
+            return false;
+        }
+        memory = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(memory == MAP_FAILED) {
+            memory = NULL;
+            error = "cannot read";
+            return false;
+        }
+        bytes = st.st_size;
+        const telemetry_header *header = (const telemetry_header *)memory;
+        if(header->magic != magic) error = "not a telemetry recording";
+        else if(header->version != TELEMETRY_VERSION || header->entry_size != entrySize) {
+            error = "recorded with another telemetry layout";
+        } else {
+            entries = (bytes - sizeof(telemetry_header)) / entrySize;
+            return true;
+        }
+        munmap(memory, bytes);
+        memory = NULL;
+        bytes = 0;
+        return false;
+    }
+
+    public:
+
+    TelemetryLog() {
+        mapping = NULL;
+        mappedBytes = 0;
+        count = 0;
+        inputMapping = NULL;
+        inputBytes = 0;
+        inputCount = 0;
+        error = "";
+    }
+
+    ~TelemetryLog() {
+        if(mapping != NULL) munmap(mapping, mappedBytes);
+        if(inputMapping != NULL) munmap(inputMapping, inputBytes);
+    }
+
+    /* the run's inputs are optional, a run without its sidecar can still be compared and queried */
+    bool open(const char *path) {
+        if(!mapEntries(path, TELEMETRY_MAGIC, sizeof(telemetry_record), mapping, mappedBytes, count)) return false;
+        const char *runError = error;
+        mapEntries(telemetryInputsPath(path).c_str(), TELEMETRY_INPUTS_MAGIC, sizeof(telemetry_input), inputMapping,
+                   inputBytes, inputCount);
+        error = runError;
+        return true;
+    }
+
+    const char *getError() const { return error; }
+
+    const telemetry_record *records() const {
+        return mapping != NULL ? (const telemetry_record *)((const telemetry_header *)mapping + 1) : NULL;
+    }
+
+    size_t size() const { return count; }
+
+    const telemetry_input *inputs() const {
+        return inputMapping != NULL ? (const telemetry_input *)((const telemetry_header *)inputMapping + 1) : NULL;
+    }
+
+    size_t getInputCount() const { return inputCount; }
+
+};
+
+
+/* first tick where two runs differ, or -1 if they agree over their common length and have the same length.
+   Once two chain hashes differ they stay different, so this is a binary search over the chain. */
+
+inline long firstDivergence(const telemetry_record *a, size_t countA, const telemetry_record *b, size_t countB) {
+    size_t common = countA < countB ? countA : countB;
+    size_t low = 0, high = common;     // every tick before low agrees
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if(a[mid].chain_hash == b[mid].chain_hash) low = mid + 1;
+        else high = mid;
+    }
+    if(low < common) return (long)low;
+    return countA == countB ? -1 : (long)common;
+}
+
+#endif
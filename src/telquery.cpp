@@ -0,0 +1,421 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#include "telemetry.hpp"
+
+using namespace std;
+
+/* Searches recorded runs (--record) for ticks matching a query such as
+       speed > 50 and cars_in_front and wipers_on
+   Each run gets a sidecar index, <run>.idx, with min/max of every column and which
+   flags occur in every block of 1024 ticks, so blocks that cannot match are never read.
+   Files are searched in parallel and matches are printed as each worker fills a buffer. */
+
+static const uint32_t INDEX_MAGIC = 0x414c5449;    // "ALTI"
+static const uint32_t INDEX_VERSION = 1;
+static const uint32_t BLOCK_TICKS = 1024;
+
+enum Column { COL_TICK, COL_VELOCITY, COL_SPEED, COL_FRONT, COL_BEHIND, COL_LIGHT, COL_GEAR, COL_LANE, COLUMNS };
+
+const char *column_names[COLUMNS] = {"tick", "velocity", "speed", "front", "behind", "light", "gear", "lane"};
+
+// status flags in the low bits, telemetry events from bit 16
+const char *flag_names[32] = {
+    "cruise_control", "wipers_on", "cars_in_front", "cars_in_back", "cars_on_left", "cars_on_right",
+    "rear_view", "left_turn", "right_turn", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    "hard_brake", "lane_change", "lane_change_refused", "high_beams_toggled", "cc_dropped", "rear_camera_on"
+};
+
+struct index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;    // sizeof(telemetry_record) of the run it was built from
+    uint32_t block_ticks;
+    uint64_t record_count;
+    uint64_t block_count;
+};
+
+struct block_summary {
+    double min[COLUMNS];
+    double max[COLUMNS];
+    uint32_t any;    // flags set in at least one tick
+    uint32_t all;    // flags set in every tick
+};
+
+double column_value(const telemetry_record &r, int column) {
+    switch (column) {
+        case COL_TICK: return (double)r.tick;
+        case COL_VELOCITY: return r.velocity;
+        case COL_SPEED: return r.status.speed;
+        case COL_FRONT: return r.distance_in_front;
+        case COL_BEHIND: return r.distance_behind;
+        case COL_LIGHT: return r.light_level;
+        case COL_GEAR: return r.status.gear;
+        default: return r.status.lane;
+    }
+}
+
+uint32_t record_flags(const telemetry_record &r) {
+    const status_struct &s = r.status;
+    uint32_t flags = (uint32_t)s.cruise_control_active | (uint32_t)s.wipers_on << 1 | (uint32_t)s.cars_in_front << 2
+                   | (uint32_t)s.cars_in_back << 3 | (uint32_t)s.cars_on_left << 4 | (uint32_t)s.cars_on_right << 5
+                   | (uint32_t)s.rear_view << 6 | (uint32_t)s.leftTurn << 7 | (uint32_t)s.rightTurn << 8;
+    return flags | (r.events & 0xffff) << 16;
+}
+
+
+/* Index */
+
+string index_path(const string &run) { return run + ".idx"; }
+
+vector<block_summary> build_index(const TelemetryLog &log) {
+    size_t count = log.size();
+    vector<block_summary> blocks((count + BLOCK_TICKS - 1) / BLOCK_TICKS);
+    for (size_t b = 0; b < blocks.size(); b++) {
+        block_summary &summary = blocks[b];
+        size_t first = b * BLOCK_TICKS;
+        size_t last = first + BLOCK_TICKS < count ? first + BLOCK_TICKS : count;
+        for (int c = 0; c < COLUMNS; c++) summary.min[c] = summary.max[c] = column_value(log.records()[first], c);
+        summary.any = 0;
+        summary.all = ~0u;
+        for (size_t i = first; i < last; i++) {
+            const telemetry_record &r = log.records()[i];
+            for (int c = 0; c < COLUMNS; c++) {
+                double v = column_value(r, c);
+                if (v < summary.min[c]) summary.min[c] = v;
+                if (v > summary.max[c]) summary.max[c] = v;
+            }
+            uint32_t flags = record_flags(r);
+            summary.any |= flags;
+            summary.all &= flags;
+        }
+    }
+    return blocks;
+}
+
+bool write_index(const string &run, const TelemetryLog &log, const vector<block_summary> &blocks) {
+    index_header header = {INDEX_MAGIC, INDEX_VERSION, (uint32_t)sizeof(telemetry_record), BLOCK_TICKS,
+                           log.size(), blocks.size()};
+    string temporary = index_path(run) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == NULL) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+           && (blocks.empty() || fwrite(blocks.data(), sizeof(block_summary), blocks.size(), file) == blocks.size());
+    ok = fclose(file) == 0 && ok;
+    // renamed into place so a concurrent query never sees half an index
+    if (ok) ok = rename(temporary.c_str(), index_path(run).c_str()) == 0;
+    if (!ok) remove(temporary.c_str());
+    return ok;
+}
+
+/* the run's index if it exists and was built from the run as it is now */
+bool read_index(const string &run, const TelemetryLog &log, vector<block_summary> &blocks) {
+    struct stat run_stat, index_stat;
+    if (stat(run.c_str(), &run_stat) != 0 || stat(index_path(run).c_str(), &index_stat) != 0) return false;
+    if (index_stat.st_mtim.tv_sec < run_stat.st_mtim.tv_sec
+        || (index_stat.st_mtim.tv_sec == run_stat.st_mtim.tv_sec && index_stat.st_mtim.tv_nsec < run_stat.st_mtim.tv_nsec)) return false;
+
+    FILE *file = fopen(index_path(run).c_str(), "rb");
+    if (file == NULL) return false;
+    index_header header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+           && header.magic == INDEX_MAGIC && header.version == INDEX_VERSION
+           && header.record_size == sizeof(telemetry_record) && header.block_ticks == BLOCK_TICKS
+           && header.record_count == log.size()
+           && header.block_count == (log.size() + BLOCK_TICKS - 1) / BLOCK_TICKS;
+    if (ok) {
+        blocks.resize(header.block_count);
+        ok = blocks.empty() || fread(blocks.data(), sizeof(block_summary), blocks.size(), file) == blocks.size();
+    }
+    fclose(file);
+    return ok;
+}
+
+
+/* Queries, a conjunction of "column op number", "flag" and "not flag" */
+
+enum Comparison { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, EQUAL, NOT_EQUAL };
+
+struct range_term {
+    int column;
+    Comparison op;
+    double value;
+};
+
+struct query {
+    uint32_t required;
+    uint32_t forbidden;
+    vector<range_term> ranges;
+};
+
+bool compare(double v, Comparison op, double value) {
+    switch (op) {
+        case LESS: return v < value;
+        case LESS_EQUAL: return v <= value;
+        case GREATER: return v > value;
+        case GREATER_EQUAL: return v >= value;
+        case EQUAL: return v == value;
+        default: return v != value;
+    }
+}
+
+/* false only if no tick in the block can match */
+bool block_may_match(const query &q, const block_summary &b) {
+    if ((b.any & q.required) != q.required || (b.all & q.forbidden) != 0) return false;
+    for (size_t i = 0; i < q.ranges.size(); i++) {
+        const range_term &t = q.ranges[i];
+        double low = b.min[t.column], high = b.max[t.column];
+        bool possible;
+        switch (t.op) {
+            case LESS: possible = low < t.value; break;
+            case LESS_EQUAL: possible = low <= t.value; break;
+            case GREATER: possible = high > t.value; break;
+            case GREATER_EQUAL: possible = high >= t.value; break;
+            case EQUAL: possible = low <= t.value && t.value <= high; break;
+            default: possible = !(low == t.value && high == t.value); break;
+        }
+        if (!possible) return false;
+    }
+    return true;
+}
+
+bool record_matches(const query &q, const telemetry_record &r) {
+    uint32_t flags = record_flags(r);
+    if ((flags & q.required) != q.required || (flags & q.forbidden) != 0) return false;
+    for (size_t i = 0; i < q.ranges.size(); i++) {
+        const range_term &t = q.ranges[i];
+        if (!compare(column_value(r, t.column), t.op, t.value)) return false;
+    }
+    return true;
+}
+
+vector<string> tokenize(const string &text) {
+    vector<string> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (isspace((unsigned char)c)) {
+            i++;
+        } else if (strchr("<>=!", c) != NULL) {
+            size_t length = i + 1 < text.size() && text[i + 1] == '=' ? 2 : 1;
+            tokens.push_back(text.substr(i, length));
+            i += length;
+        } else {
+            size_t start = i;
+            while (i < text.size() && !isspace((unsigned char)text[i]) && strchr("<>=!", text[i]) == NULL) i++;
+            tokens.push_back(text.substr(start, i - start));
+        }
+    }
+    return tokens;
+}
+
+int find_name(const char *const *names, int count, const string &name) {
+    for (int i = 0; i < count; i++) {
+        if (names[i] != NULL && name == names[i]) return i;
+    }
+    return -1;
+}
+
+bool parse_query(const string &text, query &q, string &error) {
+    static const char *operators[] = {"<", "<=", ">", ">=", "==", "!="};
+    vector<string> tokens = tokenize(text);
+    q.required = 0;
+    q.forbidden = 0;
+    q.ranges.clear();
+    size_t i = 0;
+    while (true) {
+        if (i >= tokens.size()) {
+            error = "expected a column or flag at the end";
+            return false;
+        }
+        bool negated = tokens[i] == "not";
+        if (negated) i++;
+        if (i >= tokens.size()) {
+            error = "expected a flag after not";
+            return false;
+        }
+        int flag = find_name(flag_names, 32, tokens[i]);
+        int column = find_name(column_names, COLUMNS, tokens[i]);
+        if (flag >= 0) {
+            if (negated) q.forbidden |= 1u << flag;
+            else q.required |= 1u << flag;
+            i++;
+        } else if (column >= 0 && !negated) {
+            int op = i + 1 < tokens.size() ? find_name(operators, 6, tokens[i + 1]) : -1;
+            char *end = NULL;
+            double value = i + 2 < tokens.size() ? strtod(tokens[i + 2].c_str(), &end) : 0;
+            if (op < 0 || end == NULL || *end != '\0' || end == tokens[i + 2].c_str()) {
+                error = "expected " + tokens[i] + " <op> <number>";
+                return false;
+            }
+            range_term term = {column, (Comparison)op, value};
+            q.ranges.push_back(term);
+            i += 3;
+        } else {
+            error = "unknown " + string(negated ? "flag " : "column or flag ") + tokens[i];
+            return false;
+        }
+        if (i == tokens.size()) return true;
+        if (tokens[i] != "and") {
+            error = "expected and, found " + tokens[i];
+            return false;
+        }
+        i++;
+    }
+}
+
+
+/* Parallel work over files */
+
+struct search_totals {
+    atomic<unsigned long> matches{0};
+    atomic<unsigned long> blocks{0};
+    atomic<unsigned long> blocks_read{0};
+    atomic<int> failures{0};
+};
+
+mutex output_lock;
+
+void flush_output(string &buffer) {
+    if (buffer.empty()) return;
+    lock_guard<mutex> lock(output_lock);
+    fwrite(buffer.data(), 1, buffer.size(), stdout);
+    fflush(stdout);
+    buffer.clear();
+}
+
+void search_file(const string &run, const query &q, bool count_only, search_totals &totals) {
+    TelemetryLog log;
+    if (!log.open(run.c_str())) {
+        string message = run + ": " + log.getError() + "\n";
+        fputs(message.c_str(), stderr);
+        totals.failures++;
+        return;
+    }
+    vector<block_summary> blocks;
+    if (!read_index(run, log, blocks)) {
+        blocks = build_index(log);
+        if (!write_index(run, log, blocks)) {
+            string message = run + ": searching without an index, cannot write " + index_path(run) + "\n";
+            fputs(message.c_str(), stderr);
+        }
+    }
+
+    string buffer;
+    unsigned long matches = 0, read = 0;
+    char line[160];
+    for (size_t b = 0; b < blocks.size(); b++) {
+        if (!block_may_match(q, blocks[b])) continue;
+        read++;
+        size_t first = b * BLOCK_TICKS;
+        size_t last = first + BLOCK_TICKS < log.size() ? first + BLOCK_TICKS : log.size();
+        for (size_t i = first; i < last; i++) {
+            const telemetry_record &r = log.records()[i];
+            if (!record_matches(q, r)) continue;
+            matches++;
+            if (count_only) continue;
+            snprintf(line, sizeof(line), "\t%llu\t%.2f mph\tgear %d\tlane %d\n",
+                     (unsigned long long)r.tick, r.velocity, r.status.gear, r.status.lane);
+            buffer += run;
+            buffer += line;
+        }
+        if (buffer.size() >= 64 * 1024) flush_output(buffer);
+    }
+    if (count_only) buffer = run + "\t" + to_string(matches) + "\n";
+    flush_output(buffer);
+
+    totals.matches += matches;
+    totals.blocks += blocks.size();
+    totals.blocks_read += read;
+}
+
+void index_file(const string &run, search_totals &totals) {
+    TelemetryLog log;
+    if (!log.open(run.c_str()) || !write_index(run, log, build_index(log))) {
+        string message = run + ": cannot index" + (log.getError()[0] != '\0' ? string(", ") + log.getError() : "") + "\n";
+        fputs(message.c_str(), stderr);
+        totals.failures++;
+        return;
+    }
+    totals.blocks += (log.size() + BLOCK_TICKS - 1) / BLOCK_TICKS;
+}
+
+/* runs work(file) for every file on up to one thread per core */
+template <typename Work>
+void for_each_file(const vector<string> &files, Work work) {
+    atomic<size_t> next(0);
+    unsigned workers = thread::hardware_concurrency();
+    if (workers == 0) workers = 4;
+    if (workers > files.size()) workers = files.size();
+    vector<thread> threads;
+    for (unsigned w = 0; w < workers; w++) {
+        threads.push_back(thread([&]() {
+            for (size_t i = next++; i < files.size(); i = next++) work(files[i]);
+        }));
+    }
+    for (size_t w = 0; w < threads.size(); w++) threads[w].join();
+}
+
+void usage() {
+    cout << "usage: telquery index <run>...\n"
+         << "       telquery query [--count] \"<condition> and ...\" <run>...\n\n"
+         << "conditions: <column> <op> <number>, <flag> or not <flag>\n"
+         << "columns:";
+    for (int c = 0; c < COLUMNS; c++) cout << " " << column_names[c];
+    cout << "\nflags:";
+    for (int f = 0; f < 32; f++) {
+        if (flag_names[f] != NULL) cout << " " << flag_names[f];
+    }
+    cout << endl;
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    string command = argv[1];
+    search_totals totals;
+
+    if (command == "index") {
+        vector<string> files(argv + 2, argv + argc);
+        for_each_file(files, [&](const string &run) { index_file(run, totals); });
+        cerr << files.size() - totals.failures << " runs indexed, " << totals.blocks << " blocks" << endl;
+        return totals.failures == 0 ? 0 : 1;
+    }
+
+    if (command == "query") {
+        int arg = 2;
+        bool count_only = false;
+        if (strcmp(argv[arg], "--count") == 0) {
+            count_only = true;
+            arg++;
+        }
+        if (arg + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        query q;
+        string error;
+        if (!parse_query(argv[arg], q, error)) {
+            cerr << "bad query: " << error << endl;
+            return 2;
+        }
+        vector<string> files(argv + arg + 1, argv + argc);
+        for_each_file(files, [&](const string &run) { search_file(run, q, count_only, totals); });
+        cerr << totals.matches << " matching ticks, read " << totals.blocks_read << " of " << totals.blocks
+             << " blocks" << endl;
+        return totals.failures == 0 ? 0 : 1;
+    }
+
+    usage();
+    return 2;
+}
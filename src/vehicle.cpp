@@ -1,3 +1,6 @@
+#ifndef VEHICLE_CPP
+#define VEHICLE_CPP
+
 #include <string>
 #include <iostream>
 #include <cstring>
@@ -8,8 +11,21 @@
 #include <limits.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "vehicle.hpp"
+#include "numeric.hpp"
+#include "telemetry.hpp"
+#include "status_ring.hpp"
+#include "rules.hpp"
 
 
 /* Signal handling for test inputs */
@@ -26,27 +42,89 @@ void vehicle_handler(int signum) {
 }
 
 
+/* State hashing */
+
+// Every mutable field adds fieldHash(field, value) into an XOR sum, so a write only swaps the
+// old contribution for the new one and a component's hash never has to be recomputed per tick.
+
+enum StateField {
+    FIELD_VELOCITY,
+    FIELD_LANE_WIDTH, FIELD_RIGHT_LINE, FIELD_LEFT_LINE, FIELD_MARKED_ROAD,
+    FIELD_ROAD, FIELD_NUM_LANES, FIELD_LANE,
+    FIELD_LIGHT_LEVEL, FIELD_DISTANCE_FRONT, FIELD_DISTANCE_BEHIND, FIELD_OBJECT_RIGHT, FIELD_OBJECT_LEFT, FIELD_RAIN,
+    FIELD_CRUISE_CONTROL, FIELD_WIPERS, FIELD_HEADLIGHTS, FIELD_GEAR, FIELD_TURN_SIGNAL,
+    FIELD_WANTS_ACC, FIELD_WANTS_BRK, FIELD_SPEED_WANTED
+};
+
+inline uint64_t mixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t fieldHash(int field, uint64_t bits) { return mixHash(bits + 0x9e3779b97f4a7c15ULL * (field + 1)); }
+
+inline uint64_t intBits(long long value) { return (uint64_t)value; }
+
+inline uint32_t fieldBit(int field) { return 1u << field; }
+
+static const uint32_t ALL_FIELDS = 0xffffffffu;
+
+/* swaps a field's hash contribution and marks it dirty, does nothing if the value didn't change */
+inline void rehashField(uint64_t &hash, int field, uint64_t oldBits, uint64_t newBits) {
+    if(oldBits != newBits) hash ^= fieldHash(field, oldBits) ^ fieldHash(field, newBits);
+}
+
+/* the same, and marks the field for the display checks that read it */
+inline void rehashField(uint64_t &hash, uint32_t &dirty, int field, uint64_t oldBits, uint64_t newBits) {
+    if(oldBits == newBits) return;
+    rehashField(hash, field, oldBits, newBits);
+    dirty |= fieldBit(field);
+}
+
+
 /* Sensor Fusion */
 
 class IMU {
 
     private:
         
-    double currentVelocity;    // current speed of the vehicle
+    Numeric currentVelocity;    // current speed of the vehicle
+
+    uint64_t stateHash;
+    uint32_t dirty;         // fields written since the last takeDirty()
 
     public:
 
     IMU() {
         currentVelocity = 0;
+        stateHash = fieldHash(FIELD_VELOCITY, numericBits(currentVelocity));
+        dirty = ALL_FIELDS;
     }
 
-    IMU(double velo) {
+    IMU(Numeric velo) {
         currentVelocity = velo;
+        stateHash = fieldHash(FIELD_VELOCITY, numericBits(currentVelocity));
+        dirty = ALL_FIELDS;
     }
     
-    double getCurrentVelocity() { return currentVelocity; }
+    Numeric getCurrentVelocity() { return currentVelocity; }
+
+    void setCurrentVelocity(Numeric velo) {
+        rehashField(stateHash, dirty, FIELD_VELOCITY, numericBits(currentVelocity), numericBits(velo));
+        currentVelocity = velo;
+    }
+
+    uint64_t getStateHash() const { return stateHash; }
 
-    void setCurrentVelocity(double velo) { currentVelocity = velo; }
+    uint32_t takeDirty() {
+        uint32_t fields = dirty;
+        dirty = 0;
+        return fields;
+    }
 
 };
 
@@ -55,12 +133,23 @@ class Scanners {
     
     private:
 
-    double lane_width;    // total lane width of the current road
-    double right_line;    // distance to right line of lane
-    double left_line;     // distance to left line of lane
+    Numeric lane_width;    // total lane width of the current road
+    Numeric right_line;    // distance to right line of lane
+    Numeric left_line;     // distance to left line of lane
 
     bool marked_road;     // if the lanes are marked on the current road
 
+    uint64_t stateHash;
+    uint32_t dirty;         // fields written since the last takeDirty()
+
+    void rehash() {
+        stateHash = fieldHash(FIELD_LANE_WIDTH, numericBits(lane_width))
+                  ^ fieldHash(FIELD_RIGHT_LINE, numericBits(right_line))
+                  ^ fieldHash(FIELD_LEFT_LINE, numericBits(left_line))
+                  ^ fieldHash(FIELD_MARKED_ROAD, marked_road);
+        dirty = ALL_FIELDS;
+    }
+
     public:
 
     Scanners() {
@@ -68,35 +157,53 @@ class Scanners {
         right_line = 1;
         left_line = 1;
         marked_road = false;
+        rehash();
     }
 
-    Scanners( double width, double right, double left, bool marked) {
+    Scanners( Numeric width, Numeric right, Numeric left, bool marked) {
         lane_width = width;
         right_line = right;
         left_line = left;
         marked_road = marked;
+        rehash();
     }
 
-     void setLaneWidth(double width) {
+     void setLaneWidth(Numeric width) {
         if(!marked_road) return;
-        this->lane_width = width > 7 ? width : 7;
-        this->right_line = (width - 6) / 2;
-        this->left_line = (width - 6) / 2;
+        Numeric width_set = width > 7 ? width : 7;
+        Numeric line = (width - 6) / 2;
+        rehashField(stateHash, dirty, FIELD_LANE_WIDTH, numericBits(lane_width), numericBits(width_set));
+        rehashField(stateHash, dirty, FIELD_RIGHT_LINE, numericBits(right_line), numericBits(line));
+        rehashField(stateHash, dirty, FIELD_LEFT_LINE, numericBits(left_line), numericBits(line));
+        this->lane_width = width_set;
+        this->right_line = line;
+        this->left_line = line;
+    }
+
+    void setMarkedRoad(bool marked) {
+        rehashField(stateHash, dirty, FIELD_MARKED_ROAD, marked_road, marked);
+        this->marked_road = marked;
     }
 
-    void setMarkedRoad(bool marked) { this->marked_road = marked; }
+    uint64_t getStateHash() const { return stateHash; }
 
-    double getLaneWidth() {
+    uint32_t takeDirty() {
+        uint32_t fields = dirty;
+        dirty = 0;
+        return fields;
+    }
+
+    Numeric getLaneWidth() {
         if(!marked_road) return -1.0;
         return this->lane_width;
     }
 
-    double distanceFromLineRight() {
+    Numeric distanceFromLineRight() {
         if(!marked_road) return -1.0;
         return this->right_line;
     }
 
-    double distanceFromLineLeft() {
+    Numeric distanceFromLineLeft() {
         if(!marked_road) return -1.0;
         return this->left_line;
     }
@@ -115,6 +222,25 @@ class GPS {
 
     int numberOfLanes;         // number of lanes on the current road
     int laneNumber;            // the lane the car is in on the current road (1 is lane furthest left)
+
+    uint64_t stateHash;
+    uint32_t dirty;         // fields written since the last takeDirty()
+
+    int roadType() const { return onHighway ? 1 : onLocalRoute ? 2 : 0; }
+
+    void rehash() {
+        stateHash = fieldHash(FIELD_ROAD, roadType())
+                  ^ fieldHash(FIELD_NUM_LANES, numberOfLanes)
+                  ^ fieldHash(FIELD_LANE, laneNumber);
+        dirty = ALL_FIELDS;
+    }
+
+    void setRoad(bool H, bool L) {
+        int before = roadType();
+        this->onHighway = H;
+        this->onLocalRoute = L;
+        rehashField(stateHash, dirty, FIELD_ROAD, before, roadType());
+    }
     
     public:
 
@@ -123,6 +249,7 @@ class GPS {
         onLocalRoute = false;
         numberOfLanes = 1;
         laneNumber = 1;
+        rehash();
     }
 
     GPS(bool H, bool L, int num_lanes, int lane) {
@@ -137,26 +264,34 @@ class GPS {
         if(lane < 1) laneNumber = 1;
         else if (lane > numberOfLanes) laneNumber = numberOfLanes;
         else laneNumber = lane;
+        rehash();
     }
 
-    void setOnHighway() {
-        this->onHighway = true;
-        this->onLocalRoute = false;
-    }
+    void setOnHighway() { setRoad(true, false); }
     
-    void setOnLocalRoad() {
-        this->onHighway = false;
-        this->onLocalRoute = true;
+    void setOnLocalRoad() { setRoad(false, true); }
+
+    void setOnUnregisteredRoad() { setRoad(false, false); }
+
+    void setNumberOfLanes(int num) {
+        if(num <= 0) return;
+        rehashField(stateHash, dirty, FIELD_NUM_LANES, numberOfLanes, num);
+        this->numberOfLanes = num;
     }
 
-    void setOnUnregisteredRoad() {
-        this->onHighway = false;
-        this->onLocalRoute = false;
+    void setLaneNumber(int lane) {
+        if(lane <= 0 || lane > this->numberOfLanes) return;
+        rehashField(stateHash, dirty, FIELD_LANE, laneNumber, lane);
+        this->laneNumber = lane;
     }
 
-    void setNumberOfLanes(int num) { if(num > 0) this->numberOfLanes = num; }
+    uint64_t getStateHash() const { return stateHash; }
 
-    void setLaneNumber(int lane) { if(lane > 0 && lane <= this->numberOfLanes) this->laneNumber = lane; }
+    uint32_t takeDirty() {
+        uint32_t fields = dirty;
+        dirty = 0;
+        return fields;
+    }
     
     bool isOnHighway() { return this->onHighway; }
 
@@ -171,52 +306,229 @@ class GPS {
 };
 
 
+class RearCamera {
+
+    public:
+
+    static const int WIDTH = 64;          // frame width in pixels
+    static const int HEIGHT = 48;         // frame height in pixels, bottom row is right behind the bumper
+    static const int FRAME_SIZE = WIDTH * HEIGHT;
+    static const int RING_SIZE = 8;       // frames held in the ring
+    static const int BRIGHT = 128;        // pixels at or above this level are part of an object
+    static const int MIN_PIXELS = 8;      // bright pixels a row needs to count as an object edge
+
+    private:
+
+    alignas(16) unsigned char frames[RING_SIZE][FRAME_SIZE];   // grayscale frames, never copied out
+
+    int writeIndex;     // slot the next frame is written into
+    int readIndex;      // slot the detector reads next
+    int count;          // number of valid frames in the ring
+    bool playback;      // true if frames were loaded from disk and are looped
+
+    int brightPixels(const unsigned char *row) const {
+        int hits = 0;
+    #ifdef __SSE2__
+        // max(px, BRIGHT) == px exactly when px >= BRIGHT as unsigned bytes, one mask bit per bright pixel
+        const __m128i bright = _mm_set1_epi8((char)BRIGHT);
+        for (int x = 0; x < WIDTH; x += 16) {
+            __m128i px = _mm_loadu_si128((const __m128i *)(row + x));
+            hits += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(px, bright), px)));
+        }
+    #else
+        for (int x = 0; x < WIDTH; x++) hits += row[x] >= BRIGHT;
+    #endif
+        return hits;
+    }
+
+    public:
+
+    RearCamera() {
+        writeIndex = 0;
+        readIndex = -1;
+        count = 0;
+        playback = false;
+    }
+
+    unsigned char *frame(int index) { return frames[index]; }
+
+    const unsigned char *frame(int index) const { return frames[index]; }
+
+    int frameCount() const { return count; }
+
+    bool isPlayback() const { return playback; }
+
+    /* producer side: fill frame(nextSlot()) in place, then publish it */
+
+    int nextSlot() const { return writeIndex; }
+
+    void publish() {
+        readIndex = writeIndex;
+        writeIndex = (writeIndex + 1) % RING_SIZE;
+        if(count < RING_SIZE) count++;
+    }
+
+    /* draws a car whose bumper is distance rows above the bottom of the frame */
+    void synthesize(double distance) {
+        unsigned char *px = frames[writeIndex];
+        memset(px, 16, FRAME_SIZE);
+        if(distance >= 0 && distance < HEIGHT) {
+            int bottom = HEIGHT - 1 - (int)distance;
+            int top = bottom - 5 > 0 ? bottom - 5 : 0;
+            for (int y = top; y <= bottom; y++) {
+                memset(px + y * WIDTH + WIDTH / 4, 220, WIDTH / 2);
+            }
+        }
+        publish();
+    }
+
+    /* loads raw 8-bit WIDTH x HEIGHT frames straight into the ring, returns frames read or -1 */
+    int loadFrames(const char *path) {
+        FILE *file = fopen(path, "rb");
+        if(file == NULL) return -1;
+        writeIndex = 0;
+        count = 0;
+        while (count < RING_SIZE && fread(frames[count], 1, FRAME_SIZE, file) == FRAME_SIZE) count++;
+        fclose(file);
+        readIndex = count > 0 ? 0 : -1;
+        writeIndex = count % RING_SIZE;
+        playback = count > 0;
+        return count;
+    }
+
+    /* index of the frame to process this tick, -1 if there is none */
+    int currentFrame() {
+        if(count == 0) return -1;
+        int index = readIndex;
+        if(playback) readIndex = (readIndex + 1) % count;
+        return index;
+    }
+
+    /* distance to the nearest object in the frame, INT_MAX if nothing is in range */
+    double detectDistance(int index) const {
+        const unsigned char *px = frames[index];
+        for (int y = HEIGHT - 1; y >= 0; y--) {
+            if(brightPixels(px + y * WIDTH) >= MIN_PIXELS) return HEIGHT - 1 - y;
+        }
+        return INT_MAX;
+    }
+
+};
+
+
 class SensorsAndCameras {
 
     private:
     
-    double lightLevel;         // light level outside
-    double distanceInFront;    // distance of car in front
-    double distanceBehind;     // distance of car behind
+    Numeric lightLevel;         // light level outside
+    Numeric distanceInFront;    // distance of car in front
+    Numeric distanceBehind;     // distance of car behind
 
     bool objectRight;       // true if object to right, false if not
     bool objectLeft;        // true if object to left, false if not
     bool rainDetected;      // true if its raining, false if its not
+
+    std::unique_ptr<RearCamera> rearCamera;    // only allocated when the camera is enabled
+
+    uint64_t stateHash;
+    uint32_t dirty;         // fields written since the last takeDirty()
     
     public:
 
     SensorsAndCameras() {
+        reset();
+    }
+
+    /* back to the default environment, keeps the camera; a synthetic camera gets an empty frame so the
+       car it last drew is not detected again */
+    void reset() {
         this->lightLevel = 200;
         this->distanceInFront = INT_MAX;
         this->distanceBehind = INT_MAX;
         this->objectRight = false;
         this->objectLeft = false;
         this->rainDetected = false;
+        stateHash = fieldHash(FIELD_LIGHT_LEVEL, numericBits(lightLevel))
+                  ^ fieldHash(FIELD_DISTANCE_FRONT, numericBits(distanceInFront))
+                  ^ fieldHash(FIELD_DISTANCE_BEHIND, numericBits(distanceBehind))
+                  ^ fieldHash(FIELD_OBJECT_RIGHT, objectRight)
+                  ^ fieldHash(FIELD_OBJECT_LEFT, objectLeft)
+                  ^ fieldHash(FIELD_RAIN, rainDetected);
+        dirty = ALL_FIELDS;
+        synthesizeRearFrame(INT_MAX);
+    }
+
+    /* allocates the frame ring, loading it from path if given, returns false if the file can't be read */
+    bool enableRearCamera(const char *path) {
+        if(!rearCamera) rearCamera.reset(new RearCamera());
+        if(path == NULL) return true;
+        return rearCamera->loadFrames(path) > 0;
+    }
+
+    bool hasRearCamera() const { return rearCamera != nullptr; }
+
+    /* runs the detector on this tick's frame and takes its distance */
+    void processRearFrame() {
+        if(!rearCamera) return;
+        int index = rearCamera->currentFrame();
+        if(index < 0) return;
+        setDistanceBehind(rearCamera->detectDistance(index));
+    }
+
+    /* renders what a car at distance looks like, unless frames are played back from disk */
+    void synthesizeRearFrame(double distance) {
+        if(rearCamera && !rearCamera->isPlayback()) rearCamera->synthesize(distance);
     }
     
-    void setLightLevel(double level) { this->lightLevel = level; }
+    void setLightLevel(Numeric level) {
+        rehashField(stateHash, dirty, FIELD_LIGHT_LEVEL, numericBits(lightLevel), numericBits(level));
+        this->lightLevel = level;
+    }
 
-    void setDistanceInFront(double distance) { this->distanceInFront = distance; }
+    void setDistanceInFront(Numeric distance) {
+        rehashField(stateHash, dirty, FIELD_DISTANCE_FRONT, numericBits(distanceInFront), numericBits(distance));
+        this->distanceInFront = distance;
+    }
 
-    void setDistanceBehind(double distance) { this->distanceBehind = distance; }
+    void setDistanceBehind(Numeric distance) {
+        rehashField(stateHash, dirty, FIELD_DISTANCE_BEHIND, numericBits(distanceBehind), numericBits(distance));
+        this->distanceBehind = distance;
+    }
 
-    void setObjectRight(bool value) { this->objectRight = value; }
+    void setObjectRight(bool value) {
+        rehashField(stateHash, dirty, FIELD_OBJECT_RIGHT, objectRight, value);
+        this->objectRight = value;
+    }
 
-    void setObjectLeft(bool value) { this->objectLeft = value; }
+    void setObjectLeft(bool value) {
+        rehashField(stateHash, dirty, FIELD_OBJECT_LEFT, objectLeft, value);
+        this->objectLeft = value;
+    }
 
-    void setRain(bool value) { this->rainDetected = value; }
+    void setRain(bool value) {
+        rehashField(stateHash, dirty, FIELD_RAIN, rainDetected, value);
+        this->rainDetected = value;
+    }
 
-    double getLightLevel() const { return this->lightLevel; }
+    uint64_t getStateHash() const { return stateHash; }
+
+    uint32_t takeDirty() {
+        uint32_t fields = dirty;
+        dirty = 0;
+        return fields;
+    }
+
+    Numeric getLightLevel() const { return this->lightLevel; }
      
-    double getDistanceInFront() const { return this->distanceInFront; }
+    Numeric getDistanceInFront() const { return this->distanceInFront; }
 
-    double getDistanceBehind() const { return this->distanceBehind; }
+    Numeric getDistanceBehind() const { return this->distanceBehind; }
 
     bool isObjectRight() const { return this->objectRight; }
 
     bool isObjectLeft() const { return this->objectLeft; }
 
-    bool getRainDetected() { return this->rainDetected; }
+    bool getRainDetected() const { return this->rainDetected; }
 
 };
 
@@ -234,6 +546,33 @@ class VehicleControl {
     int gear;                   // 0 P, 1 R, 2 N, 3 D
     int turnSignal;             // -1 left, 0 none, 1 right
 
+    uint64_t stateHash;
+    uint32_t dirty;         // fields written since the last takeDirty()
+
+    void rehash() {
+        stateHash = fieldHash(FIELD_CRUISE_CONTROL, ccActive)
+                  ^ fieldHash(FIELD_WIPERS, windshieldWipers)
+                  ^ fieldHash(FIELD_HEADLIGHTS, headlightLevel)
+                  ^ fieldHash(FIELD_GEAR, gear)
+                  ^ fieldHash(FIELD_TURN_SIGNAL, intBits(turnSignal));
+        dirty = ALL_FIELDS;
+    }
+
+    void setCC(bool active) {
+        rehashField(stateHash, dirty, FIELD_CRUISE_CONTROL, ccActive, active);
+        this->ccActive = active;
+    }
+
+    void setHeadlights(int level) {
+        rehashField(stateHash, dirty, FIELD_HEADLIGHTS, headlightLevel, level);
+        this->headlightLevel = level;
+    }
+
+    void setTurnSignal(int turn) {
+        rehashField(stateHash, dirty, FIELD_TURN_SIGNAL, intBits(turnSignal), intBits(turn));
+        this->turnSignal = turn;
+    }
+
     public:
 
     VehicleControl() {
@@ -242,6 +581,7 @@ class VehicleControl {
         this->gear = 0;
         this->windshieldWipers = false;
         this->turnSignal = 0;
+        rehash();
     }
 
     VehicleControl(bool cc, bool inDrive) {
@@ -250,25 +590,41 @@ class VehicleControl {
         this->gear = inDrive ? 3 : 0;
         this->windshieldWipers = false;
         this->turnSignal = 0;
+        rehash();
     }
 
-    void startCC(IMU &imu, GPS &gps) { if(gps.isOnHighway() && imu.getCurrentVelocity() > 0) ccActive = true; }
-    void stopCC() { ccActive = false; }
+    void startCC(IMU &imu, GPS &gps) { if(gps.isOnHighway() && imu.getCurrentVelocity() > 0) setCC(true); }
+    void stopCC() { setCC(false); }
 
-    void setGear(int val) { if (val >= 0 && val <= 3) this->gear = val; }
+    void setGear(int val) {
+        if (val < 0 || val > 3) return;
+        rehashField(stateHash, dirty, FIELD_GEAR, gear, val);
+        this->gear = val;
+    }
 
-    void turnOffHeadlights() { this->headlightLevel = 0; }
+    void turnOffHeadlights() { setHeadlights(0); }
     void turnOnHeadLights(int level) {
-        if(level == 0) this->headlightLevel = 0;
-        if(level == 1) this->headlightLevel = 1;
-        if(level > 1) this->headlightLevel = 2;
+        if(level == 0) setHeadlights(0);
+        if(level == 1) setHeadlights(1);
+        if(level > 1) setHeadlights(2);
     }
 
-    void leftTurnSignal() { this->turnSignal = -1; }
-    void rightTurnSignal() { this->turnSignal = 1; }
-    void turnComplete() { turnSignal = 0; }
+    void leftTurnSignal() { setTurnSignal(-1); }
+    void rightTurnSignal() { setTurnSignal(1); }
+    void turnComplete() { setTurnSignal(0); }
 
-    void turnOnWindshieldWipers(bool wipers) { this->windshieldWipers = wipers; }
+    void turnOnWindshieldWipers(bool wipers) {
+        rehashField(stateHash, dirty, FIELD_WIPERS, windshieldWipers, wipers);
+        this->windshieldWipers = wipers;
+    }
+
+    uint64_t getStateHash() const { return stateHash; }
+
+    uint32_t takeDirty() {
+        uint32_t fields = dirty;
+        dirty = 0;
+        return fields;
+    }
 
     bool getccActive() { return this->ccActive; }
 
@@ -280,10 +636,10 @@ class VehicleControl {
 
     bool windshieldWipersOn() { return this->windshieldWipers; }
 
-    void brake(IMU &imu, SensorsAndCameras &sensorsAndCameras, int intensity) {  // intensity = 1, 2, 3,  - for if in reverse
+    void brake(IMU &imu, SensorsAndCameras &sensorsAndCameras, int intensity, const RuleConfig &rules) {  // intensity = 1, 2, 3,  - for if in reverse
         bool reversing = imu.getCurrentVelocity() < 5;
         if(intensity == 1) {
-            imu.setCurrentVelocity(imu.getCurrentVelocity() * .95);
+            imu.setCurrentVelocity(imu.getCurrentVelocity() * rules.brakeFactor[0]);
             if(this->gear == 3 || this->gear == 2 || !reversing) {
                 if(imu.getCurrentVelocity() < 5) imu.setCurrentVelocity(0);
                 else sensorsAndCameras.setDistanceInFront(sensorsAndCameras.getDistanceInFront() + 10);
@@ -291,7 +647,7 @@ class VehicleControl {
                  if(imu.getCurrentVelocity() > -5) imu.setCurrentVelocity(0);
             }
         } else if( intensity == 2) {
-            imu.setCurrentVelocity(imu.getCurrentVelocity() * .90);
+            imu.setCurrentVelocity(imu.getCurrentVelocity() * rules.brakeFactor[1]);
             if(this->gear == 3 || this->gear == 2 || !reversing ) {
                 if(imu.getCurrentVelocity() < 5) imu.setCurrentVelocity(0);
                 else sensorsAndCameras.setDistanceInFront(sensorsAndCameras.getDistanceInFront() + 15);
@@ -299,7 +655,7 @@ class VehicleControl {
                  if(imu.getCurrentVelocity() > -5) imu.setCurrentVelocity(0);
             }
         } else {
-            imu.setCurrentVelocity(imu.getCurrentVelocity() * .85);
+            imu.setCurrentVelocity(imu.getCurrentVelocity() * rules.brakeFactor[2]);
             if(this->gear == 3 || this->gear == 2 || !reversing) {
                 if(imu.getCurrentVelocity() < 5) imu.setCurrentVelocity(0);
                 else sensorsAndCameras.setDistanceInFront(sensorsAndCameras.getDistanceInFront() + 20);
@@ -309,8 +665,8 @@ class VehicleControl {
         }
     }
 
-    void brakeTo(IMU &imu, SensorsAndCameras &sensorsAndCameras, int speed) {
-        brake(imu, sensorsAndCameras, 2);
+    void brakeTo(IMU &imu, SensorsAndCameras &sensorsAndCameras, int speed, const RuleConfig &rules) {
+        brake(imu, sensorsAndCameras, 2, rules);
         if((imu.getCurrentVelocity() <= speed && this->gear == 3) ||
             imu.getCurrentVelocity() >= speed && this->gear == 1) {
                 imu.setCurrentVelocity(speed);
@@ -340,6 +696,114 @@ class VehicleControl {
 };
 
 
+/* Per-tick scratch memory */
+
+class TickArena {
+
+    private:
+
+    static const size_t CAPACITY = 64 * 1024;
+
+    alignas(16) char buffer[CAPACITY];
+    size_t used;         // bytes handed out since the last reset
+    size_t highWater;    // most bytes used by a single tick
+
+    public:
+
+    TickArena() {
+        used = 0;
+        highWater = 0;
+    }
+
+    /* returns NULL when the tick has used up the arena, never falls back to the heap */
+    void *allocate(size_t bytes, size_t align = 16) {
+        size_t start = (used + align - 1) & ~(align - 1);
+        if(start + bytes > CAPACITY) return NULL;
+        used = start + bytes;
+        if(used > highWater) highWater = used;
+        return buffer + start;
+    }
+
+    void reset() { used = 0; }
+
+    size_t getHighWater() const { return highWater; }
+
+};
+
+thread_local TickArena tickArena;    // one per thread, reset at the end of every tick
+
+
+/* fixed capacity text builder, drops whatever doesn't fit */
+
+class TextFrame {
+
+    private:
+
+    char *data;
+    size_t length;
+    size_t capacity;
+
+    public:
+
+    TextFrame(char *buffer, size_t cap) {
+        data = buffer;
+        length = 0;
+        capacity = cap;
+    }
+
+    void put(const char *text) {
+        size_t n = strlen(text);
+        if(n > capacity - length) n = capacity - length;
+        memcpy(data + length, text, n);
+        length += n;
+    }
+
+    void putInt(int value) {
+        char digits[12];
+        int i = sizeof(digits);
+        unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+        do {
+            digits[--i] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude > 0);
+        if(value < 0) digits[--i] = '-';
+        size_t n = sizeof(digits) - i;
+        if(n > capacity - length) n = capacity - length;
+        memcpy(data + length, digits + i, n);
+        length += n;
+    }
+
+    size_t size() const { return length; }
+
+};
+
+
+#ifdef ALLOC_CHECK
+
+/* counts every heap allocation so tests can assert a steady-state tick makes none */
+
+std::atomic<unsigned long> allocationCount(0);
+
+void *operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete[](void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+#endif
+
+
 /* Display */
 
 class Display {
@@ -347,220 +811,648 @@ class Display {
     private:
 
     struct status_struct status;
+    bool changed;       // status differs from the last printed frame
+
+    template <typename T> void update(T &field, T value) {
+        if(field == value) return;
+        field = value;
+        changed = true;
+    }
 
     public:
 
+    static const size_t FRAME_CAPACITY = 8192;    // a full frame is a little over 3KB
+
     Display() :
-        status{0,0,false,false,false,false,false,false,-1,0,false,1,1,false,false}
+        status{0,0,false,false,false,false,false,false,-1,0,false,1,1,false,false},
+        changed(true)
     {}
 
-    void set_status(status_struct stat) { status = stat; }
+    void set_status(status_struct stat) {
+        status = stat;
+        changed = true;
+    }
+
+    bool has_changed() const { return changed; }
 
-    void set_speed(int speed) { status.speed = speed; }
+    const status_struct &get_status() const { return status; }
+
+    void set_speed(int speed) { update(status.speed, speed); }
     
-    void set_gear(int gear) { status.gear = gear; }
+    void set_gear(int gear) { update(status.gear, gear); }
 
-    void set_cruise_control_active(bool active) { status.cruise_control_active = active; }
+    void set_cruise_control_active(bool active) { update(status.cruise_control_active, active); }
 
-    void set_wipers(bool on) { status.wipers_on = on; }
+    void set_wipers(bool on) { update(status.wipers_on, on); }
 
-    void set_cars_in_front(bool in_front) { status.cars_in_front = in_front; }
+    void set_cars_in_front(bool in_front) { update(status.cars_in_front, in_front); }
 
-    void set_cars_in_back(bool in_back) { status.cars_in_back = in_back; }
+    void set_cars_in_back(bool in_back) { update(status.cars_in_back, in_back); }
 
-    void set_cars_on_left(bool on_left) { status.cars_on_left = on_left; }
+    void set_cars_on_left(bool on_left) { update(status.cars_on_left, on_left); }
 
-    void set_cars_on_right(bool on_right) { status.cars_on_right = on_right; }
+    void set_cars_on_right(bool on_right) { update(status.cars_on_right, on_right); }
 
-    void set_lane_warning(int warning) { status.lane_warning = warning; }
+    void set_lane_warning(int warning) { update(status.lane_warning, warning); }
 
-    void set_headlights(int level) { status.headlights = level; }
+    void set_headlights(int level) { update(status.headlights, level); }
 
-    void set_rearview(bool needsRearView) { status.rear_view = needsRearView; }
+    void set_rearview(bool needsRearView) { update(status.rear_view, needsRearView); }
 
-    void set_lane(int lane) { status.lane = lane; }
+    void set_lane(int lane) { update(status.lane, lane); }
 
-    void set_num_lanes(int num_lanes) { status.num_lanes = num_lanes; }
+    void set_num_lanes(int num_lanes) { update(status.num_lanes, num_lanes); }
 
-    void set_right_turn(bool right_turn) { status.rightTurn = right_turn; }
+    void set_right_turn(bool right_turn) { update(status.rightTurn, right_turn); }
 
-    void set_left_turn(bool left_turn) { status.leftTurn = left_turn; }
+    void set_left_turn(bool left_turn) { update(status.leftTurn, left_turn); }
 
-    void print_display() {
+    /* renders the status into tick arena memory, the frame is valid until the arena is reset */
+    const char *render(size_t &length) const {
+
+        char *memory = (char *)tickArena.allocate(FRAME_CAPACITY);
+        length = 0;
+        if(memory == NULL) return NULL;
+        TextFrame out(memory, FRAME_CAPACITY);
 
         // Clear the console
-        std::cout << "\033[2J\033[1;1H";
+        out.put( "\033[2J\033[1;1H");
 
-        std::cout << "\n                                                      Alset-IoT Simulation:\n                                                Ctrl+C to change the environment\n                                                Ctrl+Z to make a vehicle input\n                                                -1 after sending signal to exit\n";
+        out.put( "\n                                                      Alset-IoT Simulation:\n                                                Ctrl+C to change the environment\n                                                Ctrl+Z to make a vehicle input\n                                                -1 after sending signal to exit\n");
         
-        std::cout <<
-                "\n                                                            " << status.speed << " mph\n\n";
+        out.put("\n                                                            ");
+        out.putInt(status.speed);
+        out.put(" mph\n\n");
                     
         if (status.gear == 0) {
-        std::cout <<
-                "                                                            [P]ark\n\n";
+        out.put(
+                "                                                            [P]ark\n\n");
         } else if (status.gear == 1) {
-        std::cout <<
-                "                                                          [R]everse\n\n";
+        out.put(
+                "                                                          [R]everse\n\n");
         } else if (status.gear == 2) {
-        std::cout <<
-                "                                                          [N]eutral\n\n";
+        out.put(
+                "                                                          [N]eutral\n\n");
         } else if (status.gear == 3) {
-        std::cout <<
-                "                                                           [D]rive\n\n";
+        out.put(
+                "                                                           [D]rive\n\n");
         }
 
 
         if (status.cars_in_front) {
-        std::cout <<
-                "                                                    |      CAR HERE      |\n";
+        out.put(
+                "                                                    |      CAR HERE      |\n");
         } else {
-        std::cout <<
-                "                                                    |                    |\n";
+        out.put(
+                "                                                    |                    |\n");
         }
         
         if (status.lane_warning == 0) {
-        std::cout <<
-                "                         ALERT! Lane Change Warning |                    |\n";
+        out.put(
+                "                         ALERT! Lane Change Warning |                    |\n");
         } else if (status.lane_warning == 1) {
-        std::cout <<
-                "                                                    |                    | ALERT! Lane Change Warning\n";
+        out.put(
+                "                                                    |                    | ALERT! Lane Change Warning\n");
         } else {
-        std::cout <<
-                "                                                    |                    |\n";
+        out.put(
+                "                                                    |                    |\n");
         }
         
         if (status.headlights == 2) {
-        std::cout <<
-                "                                                    |     \\   / \\   /    |\n";
+        out.put(
+                "                                                    |     \\   / \\   /    |\n");
         } else {
-        std::cout <<
-                "                                                    |                    |\n";
+        out.put(
+                "                                                    |                    |\n");
         }
 
         if (status.headlights == 1 || status.headlights == 2) {
-        std::cout <<
-                "                                                    |      \\ /   \\ /     |\n";
+        out.put(
+                "                                                    |      \\ /   \\ /     |\n");
         } else {
-        std::cout <<
-                "                                                    |                    |\n";
+        out.put(
+                "                                                    |                    |\n");
         }
 
             
-        std::cout <<
-                "                                                    |      --------      |\n";
+        out.put(
+                "                                                    |      --------      |\n");
 
-        std::cout <<
-                "                                                    |    (|        |)    |\n";
+        out.put(
+                "                                                    |    (|        |)    |\n");
         
         if (status.leftTurn) {
-            std::cout <<
-                "                                                    | <-- |        |     |\n";
+            out.put(
+                "                                                    | <-- |        |     |\n");
         } else if (status.rightTurn) {
-            std::cout <<
-                "                                                    |     |        | --> |\n";
+            out.put(
+                "                                                    |     |        | --> |\n");
         } else {
-            std::cout <<
-                "                                                    |     |        |     |\n";
+            out.put(
+                "                                                    |     |        |     |\n");
         }
 
         if (status.cars_on_left && status.cars_on_right) {
-            std::cout <<
-                "                                     CAR            |     |        |     |      CAR\n";
+            out.put(
+                "                                     CAR            |     |        |     |      CAR\n");
         } else if (status.cars_on_left) {
-            std::cout <<
-                "                                     CAR            |     |        |     |\n";
+            out.put(
+                "                                     CAR            |     |        |     |\n");
         } else if (status.cars_on_right) {
-            std::cout <<
-                "                                                    |     |        |     |      CAR\n";
+            out.put(
+                "                                                    |     |        |     |      CAR\n");
         } else {
-            std::cout <<
-                "                                                    |     |        |     |\n";
+            out.put(
+                "                                                    |     |        |     |\n");
         }
 
         if (status.cars_on_left && status.cars_on_right) {
-            std::cout <<
-                "                                     HERE           |     |        |     |      HERE\n";
+            out.put(
+                "                                     HERE           |     |        |     |      HERE\n");
         } else if (status.cars_on_left) {
-            std::cout <<
-                "                                     HERE           |     |        |     |\n";
+            out.put(
+                "                                     HERE           |     |        |     |\n");
         } else if (status.cars_on_right) {
-            std::cout <<
-                "                                                    |     |        |     |      HERE\n";
+            out.put(
+                "                                                    |     |        |     |      HERE\n");
         } else {
-            std::cout <<
-                "                                                    |     |        |     |\n";
+            out.put(
+                "                                                    |     |        |     |\n");
         }
 
-        std::cout <<
-                "                                                    |    (|        |)    |\n";
+        out.put(
+                "                                                    |    (|        |)    |\n");
 
-        std::cout <<
-                "                                                    |      --------      |\n";
+        out.put(
+                "                                                    |      --------      |\n");
 
-        std::cout <<
-                "                                                    |                    |\n";
+        out.put(
+                "                                                    |                    |\n");
 
-        std::cout <<
-                "                                                    |                    |\n";
+        out.put(
+                "                                                    |                    |\n");
 
         if (status.cars_in_back) {
-            std::cout <<
-                "                                                    |      CAR HERE      |\n";
+            out.put(
+                "                                                    |      CAR HERE      |\n");
         } else {
-            std::cout <<
-                "                                                    |                    |\n";
+            out.put(
+                "                                                    |                    |\n");
         }
 
-        std::cout <<
-                "                                                    |                    |\n";
+        out.put(
+                "                                                    |                    |\n");
         
-        std::cout <<
-                "                                                    |      lane: " << status.lane << "       |\n";
+        out.put("                                                    |      lane: ");
+        out.putInt(status.lane);
+        out.put("       |\n");
 
-        std::cout <<
-                "                                                    |                    |\n\n";
+        out.put(
+                "                                                    |                    |\n\n");
 
         if (status.cruise_control_active) {
-            std::cout <<
-                "                                                    Cruise Control Active\n\n";
+            out.put(
+                "                                                    Cruise Control Active\n\n");
         }
 
         if (status.wipers_on) {
-            std::cout <<
-                "                                                           Wipers on\n";
+            out.put(
+                "                                                           Wipers on\n");
         }
 
         if (status.rear_view && status.cars_in_back) {
-        std::cout <<
-                "\n                                                     --------------------\n";
-        std::cout <<
-                "                                                    |  Rear View Camera  |\n";
-        std::cout <<
-                "                                                    |      CAR HERE      |\n";
-        std::cout <<
-                "                                                    |                    |\n";
-        std::cout <<
-                "                                                     --------------------\n";
+        out.put(
+                "\n                                                     --------------------\n");
+        out.put(
+                "                                                    |  Rear View Camera  |\n");
+        out.put(
+                "                                                    |      CAR HERE      |\n");
+        out.put(
+                "                                                    |                    |\n");
+        out.put(
+                "                                                     --------------------\n");
         } else if (status.rear_view && !status.cars_in_back) {
-        std::cout <<
-                "\n                                                     --------------------\n";
-        std::cout <<
-                "                                                    |  Rear View Camera  |\n";
-        std::cout <<
-                "                                                    |                    |\n";
-        std::cout <<
-                "                                                    |                    |\n";
-        std::cout <<
-                "                                                     --------------------\n";
+        out.put(
+                "\n                                                     --------------------\n");
+        out.put(
+                "                                                    |  Rear View Camera  |\n");
+        out.put(
+                "                                                    |                    |\n");
+        out.put(
+                "                                                    |                    |\n");
+        out.put(
+                "                                                     --------------------\n");
         }
+
+        length = out.size();
+        return memory;
+    }
+
+    void print_display() {
+        size_t length;
+        const char *frame = render(length);
+        if(frame == NULL) return;
+        fwrite(frame, 1, length, stdout);
+        fflush(stdout);
+        changed = false;
+    }
+
+    /* only prints a frame if some field of the status differs from the last one printed */
+    void print_if_changed() { if(changed) print_display(); }
+
+    /* for callers that present the status elsewhere, returns whether it changed and clears the flag */
+    bool take_changed() {
+        bool was = changed;
+        changed = false;
+        return was;
     }
 
 };
 
 
+/* Asynchronous rendering */
+
+// Three status slots: the control loop owns one, the render thread owns one, and they swap
+// through the third. Publishing never waits on the reader and the reader always gets the
+// newest snapshot, anything published in between is counted as dropped.
+
+class StatusTripleBuffer {
+
+    private:
+
+    static const int FRESH = 4;    // set on the middle index when it holds an unread snapshot
+
+    status_struct slots[3];
+    std::atomic<int> middle;
+    int back;      // written by the control loop only
+    int front;     // read by the render thread only
+
+    public:
+
+    std::atomic<unsigned long> published;
+    std::atomic<unsigned long> dropped;
+
+    StatusTripleBuffer() : middle(2), published(0), dropped(0) {
+        back = 0;
+        front = 1;
+        memset(slots, 0, sizeof(slots));
+    }
+
+    void publish(const status_struct &status) {
+        slots[back] = status;
+        int previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        if(previous & FRESH) dropped.fetch_add(1, std::memory_order_relaxed);
+        back = previous & ~FRESH;
+        published.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* newest unread snapshot, or NULL if nothing was published since the last call */
+    const status_struct *latest() {
+        if(!(middle.load(std::memory_order_acquire) & FRESH)) return NULL;
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+        return &slots[front];
+    }
+
+};
+
+
+class AsyncRenderer {
+
+    private:
+
+    StatusTripleBuffer buffer;
+    Display display;                // the render thread's own copy, never touched by the control loop
+    std::thread worker;
+    int framePeriodMs;
+
+    std::atomic<bool> running;
+    std::atomic<bool> paused;       // set while the control loop has the terminal for a prompt
+    std::atomic<bool> drawing;      // set while a frame is being written
+    std::atomic<unsigned long> rendered;
+
+    void loop() {
+        while (running.load()) {
+            drawing.store(true);
+            if(!paused.load()) {
+                const status_struct *status = buffer.latest();
+                if(status != NULL) {
+                    display.set_status(*status);
+                    display.print_display();
+                    tickArena.reset();
+                    rendered.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            drawing.store(false);
+            std::this_thread::sleep_for(std::chrono::milliseconds(framePeriodMs));
+        }
+    }
+
+    public:
+
+    AsyncRenderer(int fps) : running(true), paused(false), drawing(false), rendered(0) {
+        framePeriodMs = fps > 0 ? 1000 / fps : 33;
+        worker = std::thread(&AsyncRenderer::loop, this);
+    }
+
+    ~AsyncRenderer() { stop(); }
+
+    void publish(const status_struct &status) { buffer.publish(status); }
+
+    /* returns once no frame is being drawn, so the caller can use the terminal */
+    void pause() {
+        paused.store(true);
+        while (drawing.load()) std::this_thread::yield();
+    }
+
+    void resume() { paused.store(false); }
+
+    void stop() {
+        running.store(false);
+        if(worker.joinable()) worker.join();
+    }
+
+    unsigned long framesPublished() const { return buffer.published.load(); }
+
+    unsigned long framesRendered() const { return rendered.load(); }
+
+    unsigned long framesDropped() const { return buffer.dropped.load(); }
+
+};
+
+
+/* Trajectory tables */
+
+// brake() and accelerateTo() apply fixed factors and gap offsets, so how a manoeuvre ends only
+// depends on how it starts. Tick counts are tabulated per whole mph from the real VehicleControl
+// code, with the exact speeds inside each bucket where the count steps up, so a lookup is O(1)
+// and agrees with a step-by-step run. Anything off the tables is simulated.
+
+/* intensity the automatic braking uses for a gap in front, 0 for none */
+inline int brakeIntensity(const RuleConfig &rules, double gap) {
+    if(gap > rules.brakeGapNear && gap < rules.brakeGapFar) return 1;
+    if(gap > rules.brakeGapClose && gap <= rules.brakeGapNear) return 2;
+    if(gap > 0 && gap <= rules.brakeGapClose) return 3;
+    return 0;
+}
+
+/* a tick count that only rises or only falls with speed over 0 .. buckets, kept exact up to two
+   steps per whole mph */
+
+class StepTable {
+
+    private:
+
+    struct Bucket {
+        double bottom;        // lowest speed the vehicle's numbers hold as more than the whole mph
+        double firstStep;     // lowest speed in the bucket with afterFirst ticks
+        double secondStep;
+        int32_t whole;        // at the whole mph itself, the controls compare speeds against whole numbers
+        int32_t base;
+        int32_t afterFirst;
+        int32_t afterSecond;
+        bool exact;           // false if the count steps more than twice in this bucket
+    };
+
+    std::vector<Bucket> buckets;
+
+    /* lowest speed in (low, high] where the count is no longer value, count(low) == value != count(high) */
+    template <typename Count>
+    static double stepAbove(Count &count, double low, double high, int value) {
+        while (true) {
+            double mid = low + (high - low) / 2;
+            if(mid <= low || mid >= high) return high;
+            if(count(mid) != value) high = mid;
+            else low = mid;
+        }
+    }
+
+    public:
+
+    template <typename Count>
+    void build(int maxSpeed, Count count) {
+        buckets.resize(maxSpeed);
+        for (int speed = 0; speed < maxSpeed; speed++) {
+            Bucket &b = buckets[speed];
+            auto above = [&](double s) { return (int)((double)(Numeric)s > speed); };
+            double bottom = b.bottom = stepAbove(above, speed, speed + 1, 0);
+            double top = nextafter((double)(speed + 1), 0.0);
+            b.whole = count((double)speed);
+            b.base = b.afterFirst = b.afterSecond = count(bottom);
+            b.firstStep = b.secondStep = INFINITY;
+            b.exact = true;
+            int last = count(top);
+            if(last == b.base) continue;
+            b.firstStep = stepAbove(count, bottom, top, b.base);
+            b.afterFirst = b.afterSecond = count(b.firstStep);
+            if(b.afterFirst == last) continue;
+            b.secondStep = stepAbove(count, b.firstStep, top, b.afterFirst);
+            b.afterSecond = count(b.secondStep);
+            b.exact = b.afterSecond == last;
+        }
+    }
+
+    /* the count, or -1 if speed is off the table */
+    int lookup(double speed) const {
+        if(!(speed >= 0) || speed >= buckets.size()) return -1;
+        const Bucket &b = buckets[(size_t)speed];
+        if(speed < b.bottom) return b.whole;
+        if(!b.exact) return -1;
+        return speed < b.firstStep ? b.base : speed < b.secondStep ? b.afterFirst : b.afterSecond;
+    }
+
+#ifdef TABLE_CHECK
+    /* the first or second speed where the count steps in speed's bucket, speed if there is none */
+    double stepIn(double speed, int second) const {
+        if(!(speed >= 0) || speed >= buckets.size()) return speed;
+        const Bucket &b = buckets[(size_t)speed];
+        double step = second ? b.secondStep : b.firstStep;
+        return step == INFINITY ? speed : step;
+    }
+#endif
+
+};
+
+class TrajectoryTables {
+
+    private:
+
+    static const int MAX_SPEED = 200;       // mph covered by the tables
+    static const int MAX_TICKS = 100000;    // a manoeuvre still going after this never ends
+
+    RuleConfig rules;
+    double brakeGapStep[3];          // gap gained by a braking tick that doesn't stop, by intensity
+    double accelerateGapStep;        // gap lost by an accelerating tick
+    StepTable stop[3];               // by intensity
+    std::vector<StepTable> accelerate;     // by target speed
+
+    static int simulateStop(const RuleConfig &rules, double speed, int intensity, double &gap) {
+        VehicleControl control(true, true);
+        IMU imu(speed);
+        SensorsAndCameras sensors;
+        sensors.setDistanceInFront(gap);
+        int ticks = 0;
+        while (imu.getCurrentVelocity() != 0 && ticks < MAX_TICKS) {
+            control.brake(imu, sensors, intensity, rules);
+            ticks++;
+        }
+        gap = (double)sensors.getDistanceInFront();
+        return ticks;
+    }
+
+    static int simulateAccelerate(double speed, int target, double &gap) {
+        VehicleControl control(true, true);
+        IMU imu(speed);
+        SensorsAndCameras sensors;
+        sensors.setDistanceInFront(gap);
+        int ticks = 0;
+        do {
+            control.accelerateTo(imu, sensors, target);
+            ticks++;
+        } while (imu.getCurrentVelocity() < target && ticks < MAX_TICKS);
+        gap = (double)sensors.getDistanceInFront();
+        return ticks;
+    }
+
+    public:
+
+    explicit TrajectoryTables(const RuleConfig &config) : rules(config) {
+        for (int i = 0; i < 3; i++) {
+            double gap = 0;
+            simulateStop(rules, MAX_SPEED, i + 1, gap);    // fast enough not to stop in the first tick
+            double before = 0;
+            simulateStop(rules, MAX_SPEED * rules.brakeFactor[i], i + 1, before);
+            brakeGapStep[i] = gap - before;
+            stop[i].build(MAX_SPEED, [&](double speed) {
+                double ignored = 0;
+                return simulateStop(rules, speed, i + 1, ignored);
+            });
+        }
+        accelerateGapStep = 0;
+        simulateAccelerate(0, 1, accelerateGapStep);
+        accelerateGapStep = -accelerateGapStep;
+
+        accelerate.resize(MAX_SPEED + 1);
+        for (int target = 0; target <= MAX_SPEED; target++) {
+            accelerate[target].build(MAX_SPEED, [&](double speed) {
+                double ignored = 0;
+                return simulateAccelerate(speed, target, ignored);
+            });
+        }
+    }
+
+    uint32_t getGeneration() const { return rules.generation; }
+
+    /* brake() calls at a fixed intensity until a vehicle in drive stops, -1 if it never does */
+    int ticksToStop(double speed, int intensity) const {
+        if(intensity < 1 || intensity > 3) return -1;
+        int ticks = stop[intensity - 1].lookup(speed);
+        if(ticks < 0) {
+            double ignored = 0;
+            ticks = simulateStop(rules, speed, intensity, ignored);
+        }
+        return ticks >= MAX_TICKS ? -1 : ticks;
+    }
+
+    /* distance in front once those ticks are done, the stopping tick gains nothing */
+    double gapAfterStop(double speed, double gap, int intensity) const {
+        int ticks = ticksToStop(speed, intensity);
+        if(ticks < 0) return INFINITY;
+        return ticks > 0 ? gap + brakeGapStep[intensity - 1] * (ticks - 1) : gap;
+    }
+
+    /* accelerateTo() calls in drive until the speed reaches target */
+    int ticksToSpeed(double speed, int target) const {
+        int ticks = target >= 0 && target < (int)accelerate.size() ? accelerate[target].lookup(speed) : -1;
+        if(ticks < 0) {
+            double ignored = 0;
+            ticks = simulateAccelerate(speed, target, ignored);
+        }
+        return ticks;
+    }
+
+    /* ticks until the gap in front closes while accelerating to target in drive, -1 if it doesn't
+       close before the target speed is reached (the gap holds from then on) */
+    long predictTimeToCollision(double speed, double gap, int target) const {
+        if(gap <= 0) return 0;
+        if(accelerateGapStep <= 0) return -1;
+        long ticks = (long)ceil(gap / accelerateGapStep);
+        return ticks <= ticksToSpeed(speed, target) ? ticks : -1;
+    }
+
+#ifdef TABLE_CHECK
+    /* a speed where the stop table (which 0, 1) or the accelerate table (2, 3) steps in speed's
+       bucket, so checks land on the bisected edges */
+    double stepNear(double speed, int intensity, int target, int which) const {
+        if(which < 2) return stop[intensity - 1].stepIn(speed, which);
+        return target >= 0 && target < (int)accelerate.size() ? accelerate[target].stepIn(speed, which - 2) : speed;
+    }
+
+    /* every table answer for this start against a step-by-step run, false on any difference */
+    bool agreesWithSimulation(double speed, double gap, int intensity, int target) const {
+        double stopGap = gap;
+        int stopTicks = simulateStop(rules, speed, intensity, stopGap);
+        if(stopTicks >= MAX_TICKS) {
+            stopTicks = -1;
+            stopGap = INFINITY;
+        }
+        if(ticksToStop(speed, intensity) != stopTicks) return false;
+        // whole gaps add up exactly, others round on every tick's addition in the vehicle's numbers
+        const double tolerance = sizeof(Numeric) == sizeof(double) ? 1e-9 : 1e-5;
+        double predicted = gapAfterStop(speed, gap, intensity);
+        if(predicted != stopGap && !(fabs(predicted - stopGap) <= tolerance * fabs(stopGap))) return false;
+        double ignored = gap;
+        return ticksToSpeed(speed, target) == simulateAccelerate(speed, target, ignored);
+    }
+#endif
+
+};
+
+/* tables for the rules this thread is running with, rebuilt when the rules are reloaded */
+inline const TrajectoryTables &trajectoryTables(const RuleConfig &rules) {
+    static thread_local std::unique_ptr<TrajectoryTables> tables;
+    if(!tables || tables->getGeneration() != rules.generation) tables.reset(new TrajectoryTables(rules));
+    return *tables;
+}
+
+
 /* Planning */
 
+class Planning;
+
+RuleSet activeRules;    // thresholds every vehicle reads, swapped by a RuleWatcher
+
+/* anything that feeds menu inputs to a vehicle every tick: scenarios, input logs, driver agents */
+class TickInputs {
+
+    public:
+
+    virtual ~TickInputs() {}
+
+    virtual void apply(Planning &vehicle) = 0;
+
+};
+
+/* everything a vehicle carries from one tick to the next, plain data so it can be copied into
+   another process; the rear camera, writers and tick inputs stay with the old Planning */
+struct VehicleState {
+    VehicleControl control;
+    IMU imu;
+    Scanners scanners;
+    GPS gps;
+    Numeric lightLevel;
+    Numeric distanceInFront;
+    Numeric distanceBehind;
+    bool objectLeft;
+    bool objectRight;
+    bool raining;
+    bool wantsToAcc;
+    bool wantsToBrk;
+    int speedWanted;
+    status_struct status;
+    uint64_t chainHash;
+    uint64_t tickCount;
+};
+
 class Planning {
 
     private:
@@ -576,6 +1468,34 @@ class Planning {
     bool wantsToBrk;        // when car is told to break
     int speed_wanted;       // the speed to accelerate or break to
 
+    uint64_t planningHash;      // hash of the three fields above, no display check reads them
+    uint64_t chainHash;         // every tick's state hash folded together
+    uint64_t tickCount;
+    telemetry_record record;    // the tick being built, inputs are added as they are applied
+    TelemetryWriter *telemetry;
+    StatusRingWriter *statusRing;    // shared-memory ring for dashboards, NULL if not published
+    const RuleConfig *rules;         // pinned from tick() to endTick(), inputs are applied in between
+    uint32_t rulesGeneration;        // of the rules the last tick ran with
+    TickInputs *inputs[4];           // applied in order right after every tick
+    int inputCount;
+
+    std::unique_ptr<AsyncRenderer> renderer;    // NULL when frames are printed inside the control loop
+
+    void setWantsToAcc(bool value) {
+        rehashField(planningHash, FIELD_WANTS_ACC, wantsToAcc, value);
+        wantsToAcc = value;
+    }
+
+    void setWantsToBrk(bool value) {
+        rehashField(planningHash, FIELD_WANTS_BRK, wantsToBrk, value);
+        wantsToBrk = value;
+    }
+
+    void setSpeedWanted(int value) {
+        rehashField(planningHash, FIELD_SPEED_WANTED, intBits(speed_wanted), intBits(value));
+        speed_wanted = value;
+    }
+
     public:
     
     /* initialize an instance of every class */
@@ -587,27 +1507,43 @@ class Planning {
         gps = GPS(true, false, 4, 2);
         sensorsAndCameras = SensorsAndCameras();
         display = Display();
+
+        this->wantsToAcc = false;
+        this->wantsToBrk = false;
+        this->speed_wanted = 0;
+        planningHash = fieldHash(FIELD_WANTS_ACC, wantsToAcc)
+                     ^ fieldHash(FIELD_WANTS_BRK, wantsToBrk)
+                     ^ fieldHash(FIELD_SPEED_WANTED, intBits(speed_wanted));
+        chainHash = 0;
+        tickCount = 0;
+        memset(&record, 0, sizeof(record));
+        telemetry = NULL;
+        statusRing = NULL;
+        inputCount = 0;
+        rules = NULL;
+        rulesGeneration = 0;
     }
 
 
+    /* frames come from path, or are synthesized from environment input if path is NULL */
+    bool enableRearCamera(const char *path) { return sensorsAndCameras.enableRearCamera(path); }
+
+
     /* updates vehicle when case detected */
 
     void brakeWhenObjectDetected() {
         if(vehicleControl.getGear() == 2 || vehicleControl.getGear() == 3) {
-            if (imu.getCurrentVelocity() != 0 && sensorsAndCameras.getDistanceInFront() > 20 && sensorsAndCameras.getDistanceInFront() < 100) {
-                vehicleControl.brake(imu, sensorsAndCameras, 1);
-                wantsToAcc = false;
-            } else if (imu.getCurrentVelocity() != 0 && sensorsAndCameras.getDistanceInFront() > 10 && sensorsAndCameras.getDistanceInFront() <= 20) {
-                vehicleControl.brake(imu, sensorsAndCameras, 2);
-                wantsToAcc = false;
-            } else if (imu.getCurrentVelocity() != 0 && sensorsAndCameras.getDistanceInFront() > 0 && sensorsAndCameras.getDistanceInFront() <= 10) {
-                vehicleControl.brake(imu, sensorsAndCameras, 3);
-                wantsToAcc = false;
+            int intensity = brakeIntensity(*rules, (double)sensorsAndCameras.getDistanceInFront());
+            if (imu.getCurrentVelocity() != 0 && intensity > 0) {
+                vehicleControl.brake(imu, sensorsAndCameras, intensity, *rules);
+                if(intensity == 3) record.events |= EVENT_HARD_BRAKE;
+                setWantsToAcc(false);
             }
         } else if (vehicleControl.getGear() == 1) {
-             if (imu.getCurrentVelocity() != 0 && sensorsAndCameras.getDistanceBehind() > 0 && sensorsAndCameras.getDistanceBehind() < 20) {
-                vehicleControl.brake(imu, sensorsAndCameras, 3);
-                wantsToAcc = false;
+             if (imu.getCurrentVelocity() != 0 && sensorsAndCameras.getDistanceBehind() > 0 && sensorsAndCameras.getDistanceBehind() < rules->reverseGap) {
+                vehicleControl.brake(imu, sensorsAndCameras, 3, *rules);
+                record.events |= EVENT_HARD_BRAKE;
+                setWantsToAcc(false);
              }
         }
     }
@@ -620,40 +1556,46 @@ class Planning {
                     gps.setLaneNumber(gps.getLaneNumber() - 1);
                     vehicleControl.turnComplete();
                     sensorsAndCameras.setObjectRight(false);
+                    record.events |= EVENT_LANE_CHANGE;
                 } else {
                     vehicleControl.turnComplete();
+                    record.events |= EVENT_LANE_CHANGE_REFUSED;
                 }
             } else if (vehicleControl.getTurn() > 0) {  //right turn
                 if(!sensorsAndCameras.isObjectRight() && gps.getLaneNumber() < gps.getNumberOfLanes()) {
                     gps.setLaneNumber(gps.getLaneNumber() + 1);
                     vehicleControl.turnComplete();
                     sensorsAndCameras.setObjectLeft(false);
+                    record.events |= EVENT_LANE_CHANGE;
                 } else {
                     vehicleControl.turnComplete();
+                    record.events |= EVENT_LANE_CHANGE_REFUSED;
                 }
             }
         }
     }
 
     void automaticHeadLights() {
-        if ((sensorsAndCameras.getLightLevel() < 200 || sensorsAndCameras.getRainDetected()) && vehicleControl.getHeadLightLevel() == 0) {
+        if ((sensorsAndCameras.getLightLevel() < rules->headlightLightLevel || sensorsAndCameras.getRainDetected()) && vehicleControl.getHeadLightLevel() == 0) {
             vehicleControl.turnOnHeadLights(1);
-        } else if((sensorsAndCameras.getLightLevel() >= 200 && !sensorsAndCameras.getRainDetected()) && vehicleControl.getHeadLightLevel() > 0) {
+        } else if((sensorsAndCameras.getLightLevel() >= rules->headlightLightLevel && !sensorsAndCameras.getRainDetected()) && vehicleControl.getHeadLightLevel() > 0) {
             vehicleControl.turnOffHeadlights();
         }
     }
 
     void automaticaHighBeams() {
-        if (sensorsAndCameras.getLightLevel() < 50
-            && imu.getCurrentVelocity() > 25
+        if (sensorsAndCameras.getLightLevel() < rules->highBeamLightLevel
+            && imu.getCurrentVelocity() > rules->highBeamSpeed
             && !sensorsAndCameras.getRainDetected()
-            && sensorsAndCameras.getDistanceInFront() >= 100) {
+            && sensorsAndCameras.getDistanceInFront() >= rules->brakeGapFar) {
                 if(vehicleControl.getHeadLightLevel() == 1 ) {
                     vehicleControl.turnOnHeadLights(2);
+                    record.events |= EVENT_HIGH_BEAMS_TOGGLED;
                 }
             }
         else if(vehicleControl.getHeadLightLevel() == 2) {
             vehicleControl.turnOnHeadLights(1);
+            record.events |= EVENT_HIGH_BEAMS_TOGGLED;
         }
     }
 
@@ -678,7 +1620,10 @@ class Planning {
         }
 
         if((vehicleControl.getGear() == 0 || vehicleControl.getGear() == 1 || vehicleControl.getGear() == 2)
-            && vehicleControl.getccActive()) vehicleControl.stopCC();
+            && vehicleControl.getccActive()) {
+            vehicleControl.stopCC();
+            record.events |= EVENT_CC_DROPPED;
+        }
         else if(vehicleControl.getGear() == 3 && !vehicleControl.getccActive()) vehicleControl.startCC(imu,gps);
 
     }
@@ -687,21 +1632,26 @@ class Planning {
         int gear = vehicleControl.getGear();
         if(wantsToAcc) {
             vehicleControl.accelerateTo(imu, sensorsAndCameras, speed_wanted);
-            if(imu.getCurrentVelocity() >= speed_wanted && gear == 3) wantsToAcc = false;
-            if(imu.getCurrentVelocity() <= speed_wanted && gear == 1) wantsToAcc = false;
+            if(imu.getCurrentVelocity() >= speed_wanted && gear == 3) setWantsToAcc(false);
+            if(imu.getCurrentVelocity() <= speed_wanted && gear == 1) setWantsToAcc(false);
         }
     }
 
     void brk() {
         int gear = vehicleControl.getGear();
         if(wantsToBrk) {
-            vehicleControl.brakeTo(imu, sensorsAndCameras, speed_wanted);
-            if(imu.getCurrentVelocity() <= speed_wanted && gear == 3 ) wantsToBrk = false;
-            if(imu.getCurrentVelocity() >= speed_wanted && gear == 1 ) wantsToBrk = false;
+            vehicleControl.brakeTo(imu, sensorsAndCameras, speed_wanted, *rules);
+            if(imu.getCurrentVelocity() <= speed_wanted && gear == 3 ) setWantsToBrk(false);
+            if(imu.getCurrentVelocity() >= speed_wanted && gear == 1 ) setWantsToBrk(false);
         }
     }
 
+    void rearCameraDetection() {
+        if(vehicleControl.getGear() == 1) sensorsAndCameras.processRearFrame();
+    }
+
     void check_all() {
+        rearCameraDetection();
         brakeWhenObjectDetected();
         acc();
         brk();
@@ -716,8 +1666,8 @@ class Planning {
     /* updating display*/
 
     void automaticObjectDetection() {
-        display.set_cars_in_front(sensorsAndCameras.getDistanceInFront() < 100);
-        display.set_cars_in_back(sensorsAndCameras.getDistanceBehind() < 20);
+        display.set_cars_in_front(sensorsAndCameras.getDistanceInFront() < rules->brakeGapFar);
+        display.set_cars_in_back(sensorsAndCameras.getDistanceBehind() < rules->reverseGap);
         display.set_cars_on_left(sensorsAndCameras.isObjectLeft());
         display.set_cars_on_right(sensorsAndCameras.isObjectRight());
     }
@@ -735,7 +1685,9 @@ class Planning {
     }
 
     void automaticRearCamera() {
-        display.set_rearview(vehicleControl.getGear() == 1 && imu.getCurrentVelocity() <= 0);
+        bool rearView = vehicleControl.getGear() == 1 && imu.getCurrentVelocity() <= 0;
+        if(rearView && !display.get_status().rear_view) record.events |= EVENT_REAR_CAMERA_ON;
+        display.set_rearview(rearView);
     }
 
     void checkLanes() {
@@ -780,163 +1732,419 @@ class Planning {
         }
     }
 
+    /* only reruns the checkers whose input fields were written since the last update */
     void updateDisplay() {
-        checkGear();
-        checkTurn();
-        checkLanes();
-        automaticObjectDetection();
-        wipersOn();
-        headlightLevel();
-        currentSpeed();
-        detectLaneDeparture();
-        automaticRearCamera();
-        checkWarnings();
-        checkCC();
+        uint32_t changed = vehicleControl.takeDirty() | imu.takeDirty() | scanners.takeDirty()
+                         | gps.takeDirty() | sensorsAndCameras.takeDirty();
+        if(changed == 0) return;
+
+        if(changed & fieldBit(FIELD_GEAR)) checkGear();
+        if(changed & fieldBit(FIELD_TURN_SIGNAL)) checkTurn();
+        if(changed & fieldBit(FIELD_LANE)) checkLanes();
+        if(changed & (fieldBit(FIELD_DISTANCE_FRONT) | fieldBit(FIELD_DISTANCE_BEHIND)
+                    | fieldBit(FIELD_OBJECT_LEFT) | fieldBit(FIELD_OBJECT_RIGHT))) automaticObjectDetection();
+        if(changed & fieldBit(FIELD_WIPERS)) wipersOn();
+        if(changed & fieldBit(FIELD_HEADLIGHTS)) headlightLevel();
+        if(changed & fieldBit(FIELD_VELOCITY)) currentSpeed();
+        if(changed & (fieldBit(FIELD_GEAR) | fieldBit(FIELD_VELOCITY))) automaticRearCamera();
+        // both write the lane warning, so they always run together and in this order
+        if(changed & (fieldBit(FIELD_VELOCITY) | fieldBit(FIELD_ROAD) | fieldBit(FIELD_LEFT_LINE)
+                    | fieldBit(FIELD_RIGHT_LINE) | fieldBit(FIELD_MARKED_ROAD) | fieldBit(FIELD_TURN_SIGNAL)
+                    | fieldBit(FIELD_OBJECT_LEFT) | fieldBit(FIELD_OBJECT_RIGHT))) {
+            detectLaneDeparture();
+            checkWarnings();
+        }
+        if(changed & fieldBit(FIELD_CRUISE_CONTROL)) checkCC();
     }
 
     
+    /* one control tick, rendering is left to the caller */
+
+    void tick() {
+        rules = activeRules.enter();
+        if(rules->generation != rulesGeneration) {
+            rulesGeneration = rules->generation;
+            automaticObjectDetection();    // the display bands moved with the rules
+        }
+        record.input_count = 0;
+        record.events = 0;
+        check_all();
+        updateDisplay();
+    }
+
+    /* closes the tick: folds the state hash into the chain and records the tick */
+    void endTick() {
+        uint64_t stateHash = getStateHash();
+        chainHash = chainTelemetryHash(chainHash, stateHash, tickCount);
+
+        record.tick = tickCount;
+        record.state_hash = stateHash;
+        record.chain_hash = chainHash;
+        record.velocity = (double)imu.getCurrentVelocity();
+        record.distance_in_front = (double)sensorsAndCameras.getDistanceInFront();
+        record.distance_behind = (double)sensorsAndCameras.getDistanceBehind();
+        record.light_level = (double)sensorsAndCameras.getLightLevel();
+        record.status = display.get_status();
+        if(telemetry != NULL) telemetry->write(record);
+        if(statusRing != NULL) {
+            status_entry entry;
+            entry.tick = record.tick;
+            entry.velocity = record.velocity;
+            entry.distance_in_front = record.distance_in_front;
+            entry.distance_behind = record.distance_behind;
+            entry.light_level = record.light_level;
+            entry.status = record.status;
+            statusRing->publish(entry);
+        }
+        tickCount++;
+        activeRules.leave();
+        rules = NULL;
+    }
+
+    /* hash of every mutable field, each component keeps its own part up to date as it is written */
+    uint64_t getStateHash() const {
+        return vehicleControl.getStateHash() ^ imu.getStateHash() ^ scanners.getStateHash()
+             ^ gps.getStateHash() ^ sensorsAndCameras.getStateHash() ^ planningHash;
+    }
+
+    const telemetry_record &getLastRecord() const { return record; }
+
+    uint64_t getTickCount() const { return tickCount; }
+
+    void setTelemetry(TelemetryWriter *writer) { telemetry = writer; }
+
+    void setStatusRing(StatusRingWriter *ring) { statusRing = ring; }
+
+    static constexpr double TICKS_PER_SECOND = 0.5;    // run_systems waits 40 x 50 ms between ticks
+
+    bool addTickInputs(TickInputs *source) {
+        if(inputCount == 4) return false;
+        inputs[inputCount++] = source;
+        return true;
+    }
+
+    /* scripted inputs for the tick that just ran */
+    void applyTickInputs() {
+        if(inputCount == 0) return;
+        for (int i = 0; i < inputCount; i++) inputs[i]->apply(*this);
+        updateDisplay();
+    }
+
+    /* one tick without a terminal: control, scripted inputs, then telemetry */
+    void stepHeadless() {
+        tick();
+        applyTickInputs();
+        endTick();
+        tickArena.reset();
+    }
+
+
+    /* read-only view for scenarios and driver agents */
+
+    double getSpeed() { return (double)imu.getCurrentVelocity(); }
+
+    double getDistanceInFront() const { return (double)sensorsAndCameras.getDistanceInFront(); }
+
+    double getDistanceBehind() const { return (double)sensorsAndCameras.getDistanceBehind(); }
+
+    double getLightLevel() const { return (double)sensorsAndCameras.getLightLevel(); }
+
+    bool isRaining() { return sensorsAndCameras.getRainDetected(); }
+
+    int getGear() { return vehicleControl.getGear(); }
+
+    int getLane() { return gps.getLaneNumber(); }
+
+    int getTurnSignal() { return vehicleControl.getTurn(); }
+
+    /* sets what the sensors see of other traffic, INT_MAX for nothing in range */
+    void sense(Numeric front, Numeric behind, bool left, bool right) {
+        sensorsAndCameras.setDistanceInFront(front);
+        sensorsAndCameras.setDistanceBehind(behind);
+        sensorsAndCameras.setObjectLeft(left);
+        sensorsAndCameras.setObjectRight(right);
+    }
+
+    /* ticks until the car in front is hit if the requested acceleration carries on, -1 if it won't be */
+    long predictTimeToCollision() {
+        if(!wantsToAcc || vehicleControl.getGear() != 3) return -1;
+        return trajectoryTables(*rules).predictTimeToCollision(getSpeed(), getDistanceInFront(), speed_wanted);
+    }
+
+    const char *renderDisplay(size_t &length) const { return display.render(length); }
+
+
+    /* Moving vehicles between simulations, only between ticks */
+
+    void saveState(VehicleState &state) const {
+        state.control = vehicleControl;
+        state.imu = imu;
+        state.scanners = scanners;
+        state.gps = gps;
+        state.lightLevel = sensorsAndCameras.getLightLevel();
+        state.distanceInFront = sensorsAndCameras.getDistanceInFront();
+        state.distanceBehind = sensorsAndCameras.getDistanceBehind();
+        state.objectLeft = sensorsAndCameras.isObjectLeft();
+        state.objectRight = sensorsAndCameras.isObjectRight();
+        state.raining = sensorsAndCameras.getRainDetected();
+        state.wantsToAcc = wantsToAcc;
+        state.wantsToBrk = wantsToBrk;
+        state.speedWanted = speed_wanted;
+        state.status = display.get_status();
+        state.chainHash = chainHash;
+        state.tickCount = tickCount;
+    }
+
+    /* the state hash and the tick chain carry on from where the saved vehicle left off */
+    void restoreState(const VehicleState &state) {
+        vehicleControl = state.control;
+        imu = state.imu;
+        scanners = state.scanners;
+        gps = state.gps;
+        sensorsAndCameras.setLightLevel(state.lightLevel);
+        sensorsAndCameras.setDistanceInFront(state.distanceInFront);
+        sensorsAndCameras.setDistanceBehind(state.distanceBehind);
+        sensorsAndCameras.setObjectLeft(state.objectLeft);
+        sensorsAndCameras.setObjectRight(state.objectRight);
+        sensorsAndCameras.setRain(state.raining);
+        setWantsToAcc(state.wantsToAcc);
+        setWantsToBrk(state.wantsToBrk);
+        setSpeedWanted(state.speedWanted);
+        display.set_status(state.status);
+        chainHash = state.chainHash;
+        tickCount = state.tickCount;
+    }
+
+
+    /* Inputs, the same codes as the environment and vehicle menus */
+
+    /* every applied input is recorded in order, so a replay applies them the same way */
+    void recordInput(TelemetryInputMenu menu, int input, int val) {
+        record.input_count++;
+        if(telemetry == NULL) return;
+        telemetry_input entry;
+        entry.tick = tickCount;
+        entry.menu = menu;
+        entry.code = input;
+        entry.value = val;
+        entry.unused = 0;
+        telemetry->writeInput(entry);
+    }
+
+    void applyEnvironmentInput(int input, int val) {
+        switch(input) {
+            case 0:
+                sensorsAndCameras.reset();
+                break;
+            case 1:
+                sensorsAndCameras.setDistanceInFront(val);
+                break;
+            case 2:
+                sensorsAndCameras.setDistanceBehind(val);
+                sensorsAndCameras.synthesizeRearFrame(val);
+                break;
+            case 3:
+                if(val < 0) sensorsAndCameras.setObjectLeft(true);
+                else if(val > 0) sensorsAndCameras.setObjectRight(true);
+                else {
+                    sensorsAndCameras.setObjectLeft(false);
+                    sensorsAndCameras.setObjectRight(false);
+                }
+                break;
+            case 4:
+                if(val < 0) val = 0;
+                sensorsAndCameras.setLightLevel(val);
+                break;
+            case 5:
+                sensorsAndCameras.setRain(val > 0);
+                break;
+            default:
+                return;
+        }
+        recordInput(TELEMETRY_ENVIRONMENT, input, val);
+    }
+
+    bool canChangeGear() { return imu.getCurrentVelocity() >= -rules->gearChangeSpeed && imu.getCurrentVelocity() <= rules->gearChangeSpeed; }
+
+    void applyVehicleInput(int input, int val) {
+        switch(input) {
+            case 0:
+                imu = IMU(60);
+                gps = GPS(true, false, 4, 2);
+                break;
+            case 1:
+                if( (vehicleControl.getGear() == 3 && val < 0
+                    || val > imu.getCurrentVelocity()
+                    ) ||
+                    (vehicleControl.getGear() == 1 && val > 0 ) ||
+                    vehicleControl.getGear() == 0 ) break;
+                setWantsToBrk(true);
+                setWantsToAcc(false);
+                setSpeedWanted(val);
+                break;
+            case 2:
+                if( (vehicleControl.getGear() == 3 && val < 0) ||
+                    (vehicleControl.getGear() == 1 && val > 0 ) ||
+                    vehicleControl.getGear() == 0 ) break;
+                setWantsToAcc(true);
+                setWantsToBrk(false);
+                setSpeedWanted(val);
+                break;
+            case 3:
+                if(!canChangeGear()) break;
+                if(val == 0 || val == 1 || val == 3) vehicleControl.setGear(val);
+                // note that neutral is not fully implemented so it is not included
+                break;
+            case 4:
+                if(val < 0) vehicleControl.leftTurnSignal();
+                else if(val > 0) vehicleControl.rightTurnSignal();
+                break;
+            default:
+                return;
+        }
+        recordInput(TELEMETRY_VEHICLE, input, val);
+    }
+
+
     /* Run system */
 
-    void run_systems() {
+    /* hands the frame to the render thread, or prints it here if there is none */
+    void present(bool force) {
+        if(renderer) {
+            if(display.take_changed() || force) renderer->publish(display.get_status());
+        } else if(force) {
+            display.print_display();
+        } else {
+            display.print_if_changed();
+        }
+    }
+
+    void pauseRendering() { if(renderer) renderer->pause(); }
+
+    void resumeRendering() { if(renderer) renderer->resume(); }
+
+    [[noreturn]] void shutdown() {
+        if(renderer) renderer->stop();
+        if(statusRing != NULL) statusRing->close();    // exit() skips the owner's destructor
+        exit(0);
+    }
 
-        display.print_display();
+    void run_systems(bool asyncRender) {
+
+        if(asyncRender) renderer.reset(new AsyncRenderer(30));
+        present(true);
 
         signal(SIGINT, environment_handler);
         signal(SIGTSTP, vehicle_handler);
         
         while(true) {
 
-            check_all();
-            updateDisplay();
-            display.print_display();
+            tick();
+            applyTickInputs();
+            present(false);
 
             if (wantsEnvironmentInput) {
 
                 wantsEnvironmentInput = false;
+                pauseRendering();
 
                 int input;
                 std::cout << "\n\n                   0: default, 1: car in front, 2: car behind, 3: car to the side, 4: light level, 5: toggle rain\n";
                 std::cout << "\n                   Change Environment: ";
                 std::cin >> input;
-                int val;
+                int val = 0;
 
                 switch(input) {
                     case -1:
-                        exit(0);
-                    case 0:
-                        sensorsAndCameras = SensorsAndCameras();
-                        break;
+                        shutdown();
                     case 1:
                         std::cout << "                   Distance in front: ";
                         std::cin >> val;
-                        sensorsAndCameras.setDistanceInFront(val);
                         break;
                     case 2:
                         std::cout << "                   Distance behind: ";
                         std::cin >> val;
-                        sensorsAndCameras.setDistanceBehind(val);
                         break;
                     case 3:
                         std::cout << "                   Object left (-1) or right (1): ";
                         std::cin >> val;
-                        if(val < 0) sensorsAndCameras.setObjectLeft(true);
-                        else if(val > 0) sensorsAndCameras.setObjectRight(true);
-                        else {
-                            sensorsAndCameras.setObjectLeft(false);
-                            sensorsAndCameras.setObjectRight(false);
-                        }
                         break;
                     case 4:
                         std::cout << "                   Light Level: ";
                         std::cin >> val;
-                        if(val < 0) val = 0;
-                        sensorsAndCameras.setLightLevel(val);
                         break;
                     case 5:
                         std::cout << "                   Rain on (1) or off (0): ";
                         std::cin >> val;
-                        sensorsAndCameras.setRain(val > 0);
                         break;
                     default:
                         break;
                     }
+
+                applyEnvironmentInput(input, val);
                 
                 updateDisplay();
-                display.print_display();
+                present(true);
+                resumeRendering();
             }
 
             if (wantsVehicleInput) {
 
                 wantsVehicleInput = false;
+                pauseRendering();
 
                 int input;
                 std::cout << "\n\n                            0: default, 1: apply brake, 2: accelerate, 3: change gear, 4: turn signal\n";
                 std::cout << "\n                            Vehicle Input: ";
                 std::cin >> input;
-                int val;
+                int val = 0;
+                bool apply = true;
 
                 switch(input) {
                     case -1:
-                        exit(0);
-                    case 0:
-                        imu = IMU(60);
-                        gps = GPS(true, false, 4, 2);
-                        break;
+                        shutdown();
                     case 1:
                         std::cout << "                            Brake to what speed? ";
                         std::cin >> val;
-                        if( (vehicleControl.getGear() == 3 && val < 0
-                            || val > imu.getCurrentVelocity()
-                            ) ||
-                            (vehicleControl.getGear() == 1 && val > 0 ) ||
-                            vehicleControl.getGear() == 0 ) break;
-                        wantsToBrk = true;
-                        wantsToAcc = false;
-                        speed_wanted = val;
                         break;
                     case 2:
                         std::cout << "                            Accelerate to what speed? ";
                         std::cin >> val;
-                        if( (vehicleControl.getGear() == 3 && val < 0) ||
-                            (vehicleControl.getGear() == 1 && val > 0 ) ||
-                            vehicleControl.getGear() == 0 ) break;
-                        wantsToAcc = true;
-                        wantsToBrk = false;
-                        speed_wanted = val;
                         break;
                     case 3:
-                        if(imu.getCurrentVelocity() < -5 || imu.getCurrentVelocity() > 5) {
+                        if(!canChangeGear()) {
                             std::cout << "                            Can only change gear at low speeds\n";
                             std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+                            apply = false;
                             break;
                         }
                         std::cout << "                            Change gear to park (0), reverse (1), drive (3)? ";
                         std::cin >> val;
-                        if(val == 0 || val == 1 || val == 3) vehicleControl.setGear(val);
-                        // note that neutral is not fully implemented so it is not included
                         break;
                     case 4:
                         std::cout << "                            Turn signal left (-1) or right (1): ";
                         std::cin >> val;
-                        if(val < 0) vehicleControl.leftTurnSignal();
-                        else if(val > 0) vehicleControl.rightTurnSignal();
                         break;
                     default:
                         break;
                     }
+
+                if(apply) applyVehicleInput(input, val);
                 
                 updateDisplay();
-                display.print_display();
+                present(true);
+                resumeRendering();
             }
 
+            endTick();
+            tickArena.reset();
+
             for (int i = 0; i < 40; i++) {
                 if (!wantsEnvironmentInput && !wantsVehicleInput) std::this_thread::sleep_for(std::chrono::milliseconds(50));
             }
         }
 
     }
-
 };
 
-
-
+#endif
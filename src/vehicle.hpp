@@ -1,3 +1,6 @@
+#ifndef VEHICLE_HPP
+#define VEHICLE_HPP
+
 
 /* struct to store system/vehicle status */
 
@@ -19,4 +22,4 @@ struct status_struct {
   bool rightTurn;
 };
 
-
+#endif